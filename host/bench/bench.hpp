@@ -0,0 +1,68 @@
+#ifndef HOST_BENCH_BENCH_HPP_
+#define HOST_BENCH_BENCH_HPP_
+
+#include <stdio.h>
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+namespace bench {
+
+// Results are printed as CSV so runs can be diffed or fed to a regression script:
+// benchmark,case,iterations,total_ms,per_iter_us,checksum
+// The checksum column identifies the produced output (e.g. decoded texels), empty when not applicable.
+inline void PrintHeader() { printf("benchmark,case,iterations,total_ms,per_iter_us,checksum\n"); }
+
+inline void Report(const std::string &benchmark, const std::string &test_case, size_t iterations, double total_ms, const std::string &checksum = "") {
+    printf("%s,%s,%zu,%.3f,%.3f,%s\n", benchmark.c_str(), test_case.c_str(), iterations, total_ms, total_ms * 1000.0 / iterations, checksum.c_str());
+    fflush(stdout);
+}
+
+// Runs fn the given number of times and returns the elapsed wall time in milliseconds
+template <typename Fn>
+double Time(size_t iterations, Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) fn(i);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs fn the given number of times and reports the elapsed wall time
+template <typename Fn>
+double Run(const std::string &benchmark, const std::string &test_case, size_t iterations, Fn fn) {
+    double total_ms = Time(iterations, fn);
+    Report(benchmark, test_case, iterations, total_ms);
+    return total_ms;
+}
+
+// FNV-1a hash, used to fingerprint decoder output
+inline std::string Checksum(const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    char str[17];
+    snprintf(str, sizeof(str), "%016llx", hash);
+    return str;
+}
+
+// Scratch directory removed when the benchmark exits
+class TempDir {
+   public:
+    explicit TempDir(const std::string &name) : path_(std::filesystem::temp_directory_path() / name) {
+        std::filesystem::remove_all(path_);
+        std::filesystem::create_directories(path_);
+    }
+    ~TempDir() { std::filesystem::remove_all(path_); }
+
+    const std::filesystem::path &path() const { return path_; }
+
+   private:
+    std::filesystem::path path_;
+};
+}  // namespace bench
+
+#endif  // HOST_BENCH_BENCH_HPP_
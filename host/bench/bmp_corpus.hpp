@@ -0,0 +1,110 @@
+#ifndef HOST_BENCH_BMP_CORPUS_HPP_
+#define HOST_BENCH_BMP_CORPUS_HPP_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+struct BmpSpec {
+    const char *name;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Luma screenshot sizes (rows already 4 byte aligned) plus odd widths that force row padding
+constexpr BmpSpec kBmpCorpus[] = {
+    {"top_400x240", 400, 240},
+    {"bottom_320x240", 320, 240},
+    {"padded_399x240", 399, 240},
+    {"padded_319x240", 319, 240},
+};
+
+// Variations of the file layout that must decode to the same image
+struct BmpLayout {
+    const char *name;
+    bool top_down;         // Rows stored top to bottom, negative height
+    uint32_t header_size;  // 40 for BITMAPINFOHEADER, 108/124 for the V4/V5 headers
+    uint32_t gap;          // Bytes between the headers and the pixel rows
+};
+
+constexpr BmpLayout kBottomUp = {"bottom_up", false, 40, 0};
+
+constexpr BmpLayout kBmpLayouts[] = {
+    kBottomUp,
+    {"top_down", true, 40, 0},
+    {"v5_header", false, 124, 0},
+    {"offset_pixels", false, 40, 10},
+};
+
+// Writes a 24 bpp BMP filled with a deterministic pattern and returns its path.
+// The image is the same for every layout with the same seed.
+inline std::filesystem::path WriteBmp(const std::filesystem::path &dir, const BmpSpec &spec, uint32_t seed = 1, const BmpLayout &layout = kBottomUp) {
+    uint32_t row_size = (spec.width * 3 + 3) & ~3u;
+    uint32_t data_size = row_size * spec.height;
+    uint32_t pixel_offset = 14 + layout.header_size + layout.gap;
+
+    auto put16 = [](std::vector<char> &v, uint16_t x) {
+        v.push_back(x & 0xFF);
+        v.push_back(x >> 8);
+    };
+    auto put32 = [&put16](std::vector<char> &v, uint32_t x) {
+        put16(v, x & 0xFFFF);
+        put16(v, x >> 16);
+    };
+
+    std::vector<char> file;
+    file.reserve(pixel_offset + data_size);
+    file.push_back('B');
+    file.push_back('M');
+    put32(file, pixel_offset + data_size);
+    put32(file, 0);
+    put32(file, pixel_offset);
+
+    put32(file, layout.header_size);
+    put32(file, spec.width);
+    put32(file, layout.top_down ? -spec.height : spec.height);
+    put16(file, 1);
+    put16(file, 24);
+    put32(file, 0);
+    put32(file, data_size);
+    put32(file, 2835);
+    put32(file, 2835);
+    put32(file, 0);
+    put32(file, 0);
+    file.resize(pixel_offset, 0);
+
+    uint32_t state = seed;
+    for (uint32_t y = 0; y < spec.height; y++) {
+        for (uint32_t x = 0; x < spec.width; x++) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            // Smooth gradient with a little noise, so averaging kernels see realistic data
+            file.push_back(static_cast<char>((x * 255 / spec.width + (state & 0x0F)) & 0xFF));
+            file.push_back(static_cast<char>((y * 255 / spec.height + ((state >> 8) & 0x0F)) & 0xFF));
+            file.push_back(static_cast<char>(((x + y) * 2 + ((state >> 16) & 0x0F)) & 0xFF));
+        }
+        for (uint32_t p = spec.width * 3; p < row_size; p++) file.push_back(0);
+    }
+
+    if (layout.top_down) {
+        // Rows were generated bottom-up, flip them to keep the same image
+        for (uint32_t y = 0; y < spec.height / 2; y++) {
+            std::swap_ranges(file.begin() + pixel_offset + y * row_size, file.begin() + pixel_offset + (y + 1) * row_size,
+                             file.begin() + pixel_offset + (spec.height - 1 - y) * row_size);
+        }
+    }
+
+    auto path = dir / (std::string(spec.name) + "_" + std::to_string(seed) + "_" + layout.name + ".bmp");
+    std::ofstream(path, std::ios::binary).write(file.data(), file.size());
+    return path;
+}
+}  // namespace bench
+
+#endif  // HOST_BENCH_BMP_CORPUS_HPP_
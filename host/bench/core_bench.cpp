@@ -0,0 +1,70 @@
+// Directory scan, ordering and tagging costs over a synthetic screenshots folder.
+
+#include <3ds.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <set>
+#include <string>
+
+#include "bench.hpp"
+#include "screenshots.hpp"
+#include "settings.hpp"
+#include "tags.hpp"
+
+namespace {
+
+void CreateScreenshotFiles(const std::filesystem::path &dir, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "2023-01-01_00-%02zu-%02zu.%03zu", (i / 60000) % 60, (i / 1000) % 60, i % 1000);
+
+        std::ofstream(dir / (std::string(name) + "_top.bmp")).put('\0');
+        std::ofstream(dir / (std::string(name) + "_bot.bmp")).put('\0');
+        if (i % 4 == 0) std::ofstream(dir / (std::string(name) + "_top_right.bmp")).put('\0');
+    }
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 5000;
+
+    bench::TempDir dir("screenshot_viewer_core_bench");
+    CreateScreenshotFiles(dir.path(), count);
+    settings::SetScreenshotsPath(dir.path().string());
+    settings::SetThumbnailCachePath((dir.path() / "thumbnails").string());
+
+    bench::PrintHeader();
+    std::string test_case = std::to_string(count) + "_screenshots";
+
+    bench::Run("scan_and_order", test_case, 1, [](size_t) { screenshots::Init(); });
+
+    for (int order = screenshots::kFirst; order <= screenshots::kLast; order++) {
+        bench::Run("order", test_case + "_order_" + std::to_string(order), 10,
+                   [order](size_t) { screenshots::SetOrder(static_cast<screenshots::ScreenshotOrder>(order)); });
+    }
+
+    std::set<tags::tag_ptr> new_tags;
+    for (int i = 0; i < 8; i++) new_tags.insert(tags::AddTag({"tag" + std::to_string(i), C2D_Color32(i * 32, 0, 0, 0xFF)}));
+
+    std::set<std::string> names;
+    for (size_t i = 0; i < screenshots::Count(); i += 3) names.insert(screenshots::GetInfo(i)->name);
+
+    bench::Run("tag", test_case + "_" + std::to_string(names.size()) + "_tagged", 10, [&](size_t i) {
+        if (i % 2 == 0)
+            tags::ChangeScreenshotsTags(names, new_tags, {});
+        else
+            tags::ChangeScreenshotsTags(names, {}, new_tags);
+    });
+
+    bench::Run("filter", test_case, 10, [&](size_t i) {
+        if (i % 2 == 0)
+            tags::ChangeTagsFilter({*new_tags.begin()}, {});
+        else
+            tags::ChangeTagsFilter({}, {*new_tags.begin()});
+    });
+
+    screenshots::Exit();
+    return 0;
+}
@@ -0,0 +1,230 @@
+// Scaling of the decode pool with its number of workers. The host stand-in of threadCreate accepts as many cores as
+// hostSetNumCores allows, so the pool is run with 1, 2 and 4 workers whatever the host has; the times only scale with
+// the cores the host really has. The run fails if a pool does not start a worker per allowed core, if a full-image job
+// waits for more thumbnail jobs than there are workers, or if the decoded images, and the thumbnails and screenshot
+// the app loads through the pool, differ from the ones of a single worker.
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "bmp_corpus.hpp"
+#include "loadbmp.hpp"
+#include "screenshots.hpp"
+#include "settings.hpp"
+#include "threads/decode_pool.hpp"
+#include "ui.hpp"
+
+namespace {
+
+using screenshots::threads::DecodeJob;
+using screenshots::threads::DecodePool;
+
+constexpr u32 kWorkerCounts[] = {1, 2, 4};
+constexpr size_t kThumbnailJobs = 128;
+constexpr size_t kFullImageJobs = 24;
+constexpr size_t kScreenshots = 27;
+constexpr size_t kThumbnailsPerPage = 9;
+
+// Start order of the jobs
+std::atomic<size_t> sequence = 0;
+
+class ImageJob : public DecodeJob {
+   public:
+    std::string path;
+    C2D_Image img = {nullptr, nullptr};
+    bool thumbnail = false;
+    unsigned int error = LOADBMP_NO_ERROR;
+    size_t started = 0;
+
+    std::atomic<size_t> *left = nullptr;
+    Handle done = 0;
+
+    void Run(size_t worker, bmp_reader &reader) override {
+        started = sequence++;
+        error = thumbnail ? loadbmp_to_thumbnail(reader, path.c_str(), img) : loadbmp_to_image(reader, path.c_str(), img);
+        if (--*left == 0) svcSignalEvent(done);
+    }
+};
+
+void DeleteImage(C2D_Image image) {
+    C3D_TexDelete(image.tex);
+    delete image.tex;
+    delete image.subtex;
+}
+
+void AppendTiles(C2D_Image image, std::vector<u8> &tiles) {
+    bmp_target target = loadbmp_target(image);
+    for (u32 tile_row = 0; tile_row < target.height / 8; tile_row++) {
+        tiles.insert(tiles.end(), target.data + tile_row * target.tile_row_stride, target.data + tile_row * target.tile_row_stride + target.row_size);
+    }
+}
+
+// Decodes the jobs on the pool and waits for all of them
+void RunJobs(DecodePool &pool, std::vector<ImageJob> &jobs, screenshots::threads::DecodePriority priority) {
+    std::atomic<size_t> left = jobs.size();
+    Handle done;
+    svcCreateEvent(&done, RESET_ONESHOT);
+
+    for (auto &job : jobs) {
+        job.left = &left;
+        job.done = done;
+        pool.Submit(job, priority);
+    }
+    svcWaitSynchronization(done, U64_MAX);
+
+    svcCloseHandle(done);
+}
+
+std::vector<ImageJob> CreateJobs(const std::vector<std::string> &paths, size_t count, bool thumbnail) {
+    std::vector<ImageJob> jobs(count);
+    for (size_t i = 0; i < count; i++) {
+        jobs[i].path = paths[i % paths.size()];
+        jobs[i].thumbnail = thumbnail;
+        jobs[i].img = thumbnail ? ui::CreateImage(ui::kThumbnailWidth, ui::kThumbnailHeight) : ui::CreateImage(ui::kTopScreenWidth, ui::kTopScreenHeight);
+    }
+    return jobs;
+}
+
+std::string Checksum(std::vector<ImageJob> &jobs, int &failures) {
+    std::vector<u8> tiles;
+    for (auto &job : jobs) {
+        if (job.error) {
+            fprintf(stderr, "decoding %s failed with error %u\n", job.path.c_str(), job.error);
+            failures++;
+        }
+        AppendTiles(job.img, tiles);
+    }
+    return bench::Checksum(tiles.data(), tiles.size());
+}
+
+std::atomic<screenshots::screenshot_ptr> loaded_screenshot = nullptr;
+
+void ScreenshotLoaded(screenshots::screenshot_ptr screenshot) { loaded_screenshot = screenshot; }
+
+// Loads every thumbnail and the first screenshot through the app, returns the checksum of all of them
+std::string LoadThroughApp() {
+    screenshots::Init();
+
+    for (size_t page = 0; page < kScreenshots / kThumbnailsPerPage; page++) {
+        for (bool visible = false; !visible; std::this_thread::yield()) {
+            visible = true;
+            for (size_t i = page * kThumbnailsPerPage; i < (page + 1) * kThumbnailsPerPage; i++) {
+                visible = screenshots::HasThumbnail(screenshots::GetInfo(i)) && visible;
+            }
+        }
+    }
+
+    loaded_screenshot = nullptr;
+    screenshots::Load(screenshots::GetInfo(0), ScreenshotLoaded);
+    while (loaded_screenshot == nullptr) std::this_thread::yield();
+
+    std::vector<u8> tiles;
+    for (size_t i = 0; i < kScreenshots; i++) AppendTiles(*screenshots::GetThumbnail(screenshots::GetInfo(i)), tiles);
+    AppendTiles(loaded_screenshot.load()->top, tiles);
+    AppendTiles(loaded_screenshot.load()->bottom, tiles);
+
+    screenshots::Exit();
+    return bench::Checksum(tiles.data(), tiles.size());
+}
+
+void CreateScreenshotFiles(const std::filesystem::path &dir) {
+    for (size_t i = 0; i < kScreenshots; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "2023-01-01_00-00-00.%03zu", i);
+        std::filesystem::rename(bench::WriteBmp(dir, bench::kBmpCorpus[0], i + 1), dir / (std::string(name) + "_top.bmp"));
+        std::filesystem::rename(bench::WriteBmp(dir, bench::kBmpCorpus[1], i + 1), dir / (std::string(name) + "_bot.bmp"));
+    }
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    bench::TempDir dir("screenshot_viewer_decode_pool_bench");
+    std::vector<std::string> paths;
+    for (const auto &spec : bench::kBmpCorpus) paths.push_back(bench::WriteBmp(dir.path(), spec).string());
+
+    std::filesystem::create_directories(dir.path() / "screenshots");
+    CreateScreenshotFiles(dir.path() / "screenshots");
+    settings::SetScreenshotsPath((dir.path() / "screenshots").string());
+
+    bench::PrintHeader();
+    fprintf(stderr, "host has %u cores\n", std::thread::hardware_concurrency());
+
+    int failures = 0;
+    std::string expected[3];
+    for (u32 workers : kWorkerCounts) {
+        hostSetNumCores(workers);
+        std::string suffix = "_" + std::to_string(workers) + "_workers";
+
+        std::string checksums[3];
+        {
+            DecodePool pool;
+            if (pool.NumWorkers() != workers) {
+                fprintf(stderr, "%zu workers started on %u cores\n", pool.NumWorkers(), workers);
+                failures++;
+            }
+
+            auto thumbnails = CreateJobs(paths, kThumbnailJobs, true);
+            double total_ms = bench::Time(1, [&](size_t) { RunJobs(pool, thumbnails, screenshots::threads::kThumbnailJob); });
+            checksums[0] = Checksum(thumbnails, failures);
+            bench::Report("decode_pool", "thumbnails" + suffix, kThumbnailJobs, total_ms, checksums[0]);
+
+            auto images = CreateJobs(paths, kFullImageJobs, false);
+            total_ms = bench::Time(1, [&](size_t) { RunJobs(pool, images, screenshots::threads::kFullImageJob); });
+            checksums[1] = Checksum(images, failures);
+            bench::Report("decode_pool", "full_images" + suffix, kFullImageJobs, total_ms, checksums[1]);
+
+            // A full-image job submitted behind a queue of thumbnails only waits for the thumbnails already taken
+            std::atomic<size_t> thumbnails_left = thumbnails.size();
+            std::atomic<size_t> images_left = 1;
+            Handle thumbnails_done, image_done;
+            svcCreateEvent(&thumbnails_done, RESET_ONESHOT);
+            svcCreateEvent(&image_done, RESET_ONESHOT);
+            for (auto &job : thumbnails) {
+                job.left = &thumbnails_left;
+                job.done = thumbnails_done;
+                pool.Submit(job, screenshots::threads::kThumbnailJob);
+            }
+            images[0].left = &images_left;
+            images[0].done = image_done;
+            pool.Submit(images[0], screenshots::threads::kFullImageJob);
+            size_t submitted = sequence;
+            svcWaitSynchronization(image_done, U64_MAX);
+            svcWaitSynchronization(thumbnails_done, U64_MAX);
+            svcCloseHandle(thumbnails_done);
+            svcCloseHandle(image_done);
+
+            size_t overtaken = images[0].started > submitted ? images[0].started - submitted : 0;
+            if (overtaken > pool.NumWorkers()) {
+                fprintf(stderr, "%zu thumbnail jobs started before a full-image job with %zu workers\n", overtaken, pool.NumWorkers());
+                failures++;
+            }
+
+            for (auto &job : thumbnails) DeleteImage(job.img);
+            for (auto &job : images) DeleteImage(job.img);
+        }
+
+        // A new store every run, so the app decodes the thumbnails again
+        settings::SetThumbnailCachePath((dir.path() / ("thumbnails" + suffix)).string());
+        double total_ms = bench::Time(1, [&](size_t) { checksums[2] = LoadThroughApp(); });
+        bench::Report("decode_pool", "app" + suffix, kScreenshots, total_ms, checksums[2]);
+
+        for (int i = 0; i < 3; i++) {
+            if (expected[i].empty()) expected[i] = checksums[i];
+            if (checksums[i] != expected[i]) {
+                fprintf(stderr, "output with %u workers differs from the output with one\n", workers);
+                failures++;
+            }
+        }
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
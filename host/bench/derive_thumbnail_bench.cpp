@@ -0,0 +1,182 @@
+// Thumbnails taken from the top image of a loaded screenshot instead of its bmp. Downscaling a decoded top image is
+// timed against decoding the thumbnail from the file, for every file layout, and has to give the same texels, box
+// filtered or sampled. Then the app opens the last screenshot of the pages it jumps to, like the viewer, while the
+// thumbnails of the page are still queued. The run fails if no thumbnail is taken from a loaded screenshot or if one
+// differs from the thumbnail of its bmp.
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "bmp_corpus.hpp"
+#include "loadbmp.hpp"
+#include "screenshots.hpp"
+#include "settings.hpp"
+#include "ui.hpp"
+
+namespace {
+
+constexpr size_t kIterations = 200;
+constexpr u32 kLinearHeapSize = 10 * 1024 * 1024;
+constexpr size_t kScreenshots = 900;
+// Distinct images, so a thumbnail of another screenshot shows
+constexpr size_t kImages = 31;
+constexpr size_t kThumbnailsPerPage = 9;
+// Further apart than the pages the cache holds around the visible one
+constexpr size_t kPageStride = 37;
+constexpr size_t kJumps = 20;
+
+std::string Tiles(C2D_Image image) {
+    bmp_target target = loadbmp_target(image);
+    std::string tiles;
+    for (u32 tile_row = 0; tile_row < target.height / 8; tile_row++) {
+        tiles.append(reinterpret_cast<const char *>(target.data + tile_row * target.tile_row_stride), target.row_size);
+    }
+    return tiles;
+}
+
+void DeleteImage(C2D_Image image) {
+    C3D_TexDelete(image.tex);
+    delete image.tex;
+    delete image.subtex;
+}
+
+// Decodes the thumbnail of a bmp like the thumbnail thread does
+unsigned int DecodeThumbnail(const std::string &path, C2D_Image thumbnail, bool smooth) {
+    return smooth ? loadbmp_to_thumbnail(path, thumbnail) : loadbmp_to_image(path, thumbnail);
+}
+
+std::atomic<screenshots::screenshot_ptr> loaded_screenshot = nullptr;
+
+void ScreenshotLoaded(screenshots::screenshot_ptr screenshot) { loaded_screenshot = screenshot; }
+
+std::atomic<size_t> derived_events = 0;
+
+void RecordEvent(screenshots::ThumbnailCacheEvent event, const screenshots::ThumbnailCacheStats &stats) {
+    if (event == screenshots::kCacheDerived) derived_events++;
+}
+
+// Thumbnail texels of each image
+std::vector<std::string> CreateScreenshotFiles(const std::filesystem::path &dir) {
+    std::vector<std::string> expected;
+    C2D_Image thumbnail = ui::CreateImage(ui::kThumbnailWidth, ui::kThumbnailHeight);
+
+    std::vector<std::filesystem::path> images;
+    for (size_t i = 0; i < kImages; i++) {
+        images.push_back(bench::WriteBmp(dir, bench::kBmpCorpus[0], i + 1));
+        DecodeThumbnail(images.back().string(), thumbnail, settings::SmoothThumbnails());
+        expected.push_back(Tiles(thumbnail));
+    }
+
+    for (size_t i = 0; i < kScreenshots; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "2023-01-01_00-00-%02zu.%03zu_top.bmp", i / 1000, i % 1000);
+        std::filesystem::create_hard_link(images[i % kImages], dir / name);
+    }
+    for (auto &image : images) std::filesystem::remove(image);
+
+    DeleteImage(thumbnail);
+    return expected;
+}
+
+// Downscales the decoded top image of every layout both ways and compares with the thumbnails decoded from the file
+int CompareKernels(const std::filesystem::path &dir) {
+    int failures = 0;
+    C2D_Image top = ui::CreateImage(ui::kTopScreenWidth, ui::kTopScreenHeight);
+    C2D_Image derived = ui::CreateImage(ui::kThumbnailWidth, ui::kThumbnailHeight);
+    C2D_Image decoded = ui::CreateImage(ui::kThumbnailWidth, ui::kThumbnailHeight);
+
+    for (const auto &layout : bench::kBmpLayouts) {
+        std::string path = bench::WriteBmp(dir, bench::kBmpCorpus[0], 1, layout).string();
+        loadbmp_to_image(path, top);
+
+        for (bool smooth : {true, false}) {
+            std::string test_case = std::string(smooth ? "box_" : "sampled_") + layout.name;
+
+            unsigned int error = LOADBMP_NO_ERROR;
+            double total_ms = bench::Time(kIterations, [&](size_t) { error |= loadbmp_image_to_thumbnail(top, derived, smooth); });
+            std::string tiles = Tiles(derived);
+            bench::Report("derive", test_case, kIterations, total_ms, bench::Checksum(tiles.data(), tiles.size()));
+
+            total_ms = bench::Time(kIterations, [&](size_t) { error |= DecodeThumbnail(path, decoded, smooth); });
+            std::string expected = Tiles(decoded);
+            bench::Report("decode_file", test_case, kIterations, total_ms, bench::Checksum(expected.data(), expected.size()));
+
+            if (error || tiles != expected) {
+                fprintf(stderr, "%s: thumbnail of the decoded image differs from the one of the file\n", test_case.c_str());
+                failures++;
+            }
+        }
+        std::filesystem::remove(path);
+    }
+
+    // Only exact downscales are taken
+    if (loadbmp_image_to_thumbnail(decoded, derived, true) != LOADBMP_INVALID_DIMENSIONS) {
+        fprintf(stderr, "an image of the size of the thumbnail was downscaled\n");
+        failures++;
+    }
+
+    DeleteImage(top);
+    DeleteImage(derived);
+    DeleteImage(decoded);
+    return failures;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    bench::TempDir dir("screenshot_viewer_derive_thumbnail_bench");
+    bench::PrintHeader();
+    int failures = CompareKernels(dir.path());
+
+    std::filesystem::create_directories(dir.path() / "screenshots");
+    auto expected = CreateScreenshotFiles(dir.path() / "screenshots");
+    settings::SetScreenshotsPath((dir.path() / "screenshots").string());
+    settings::SetThumbnailCachePath((dir.path() / "thumbnails").string());
+
+    // A single worker, so the thumbnails of the page are decoded one at a time behind the screenshot
+    hostSetLinearHeapSize(kLinearHeapSize);
+    hostSetNumCores(1);
+    screenshots::SetThumbnailCacheHook(RecordEvent);
+    screenshots::Init();
+
+    size_t pages = (kScreenshots + kThumbnailsPerPage - 1) / kThumbnailsPerPage;
+    size_t mismatches = 0;
+    double total_ms = bench::Time(kJumps, [&](size_t jump) {
+        size_t page = (jump * kPageStride) % pages;
+        size_t index = std::min(kScreenshots, (page + 1) * kThumbnailsPerPage) - 1;
+        screenshots::info_ptr info = screenshots::GetInfo(index);
+
+        loaded_screenshot = nullptr;
+        screenshots::Load(info, ScreenshotLoaded);
+        while (loaded_screenshot == nullptr) std::this_thread::yield();
+
+        while (!screenshots::HasThumbnail(info)) std::this_thread::yield();
+        const C2D_Image *thumbnail = screenshots::GetThumbnail(info);
+        mismatches += thumbnail == nullptr || Tiles(*thumbnail) != expected[index % kImages];
+        screenshots::EndFrame();
+    });
+    bench::Report("open", std::to_string(kScreenshots) + "_screenshots", kJumps, total_ms);
+
+    screenshots::Exit();
+    screenshots::SetThumbnailCacheHook(nullptr);
+
+    fprintf(stderr, "%zu of %zu opened screenshots got their thumbnail from the loaded image\n", derived_events.load(), kJumps);
+    if (derived_events == 0) {
+        fprintf(stderr, "no thumbnail was taken from a loaded screenshot\n");
+        failures++;
+    }
+    if (mismatches > 0) {
+        fprintf(stderr, "%zu thumbnails of opened screenshots differ from the thumbnail of their bmp\n", mismatches);
+        failures++;
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
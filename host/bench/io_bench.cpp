@@ -0,0 +1,79 @@
+// Full screen decode time of loadbmp_to_image through every io backend available on the host, and through the stdio
+// backend at several buffer sizes, so read block sizes can be tuned without touching the decoder.
+// The run fails if any backend decodes differently from the default one.
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "bmp_corpus.hpp"
+#include "io.hpp"
+#include "loadbmp.hpp"
+#include "ui.hpp"
+
+namespace {
+
+struct BackendCase {
+    const char *name;
+    io::Backend backend;
+    size_t block_size;
+};
+
+constexpr BackendCase kBackends[] = {
+    {"stdio_4k", io::kStdio, 4 * 1024},
+    {"stdio_16k", io::kStdio, 16 * 1024},
+    {"stdio_64k", io::kStdio, 64 * 1024},
+    {"stdio_256k", io::kStdio, 256 * 1024},
+    {"mmap", io::kMmap, 0},
+};
+}  // namespace
+
+int main(int argc, char **argv) {
+    size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200;
+
+    bench::TempDir dir("screenshot_viewer_io_bench");
+    bench::PrintHeader();
+
+    int failures = 0;
+    C2D_Image image = ui::CreateImage(ui::kTopScreenWidth, ui::kTopScreenHeight);
+    std::vector<u8> expected(image.tex->size);
+
+    for (const auto &spec : bench::kBmpCorpus) {
+        std::string path = bench::WriteBmp(dir.path(), spec).string();
+
+        auto default_reader = io::CreateReader();
+        failures += loadbmp_to_image(*default_reader, path.c_str(), image) != LOADBMP_NO_ERROR;
+        memcpy(expected.data(), image.tex->data, expected.size());
+
+        for (const auto &backend : kBackends) {
+            auto reader = io::CreateReader(backend.backend, backend.block_size);
+
+            unsigned int error = LOADBMP_NO_ERROR;
+            double total_ms = bench::Time(iterations, [&](size_t) { error |= loadbmp_to_image(*reader, path.c_str(), image); });
+
+            if (error) {
+                fprintf(stderr, "loadbmp_to_image failed for %s through %s (error %u)\n", path.c_str(), backend.name, error);
+                failures++;
+            }
+
+            if (memcmp(image.tex->data, expected.data(), expected.size()) != 0) {
+                fprintf(stderr, "%s: %s backend decodes differently\n", spec.name, backend.name);
+                failures++;
+            }
+
+            bench::Report(std::string("io_") + backend.name, spec.name, iterations, total_ms, bench::Checksum(image.tex->data, image.tex->size));
+        }
+    }
+
+    C3D_TexDelete(image.tex);
+    delete image.tex;
+    delete image.subtex;
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,121 @@
+// Scalar and SIMD paths of the bmp pixel kernels over random rows. The run fails if the two paths disagree.
+// The speedup of each kernel is printed to stderr. Off the console the ARMv6 instructions are emulated with integer code,
+// so it only approximates the speedup on the console.
+
+#include <3ds.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "bmp_kernels.hpp"
+
+namespace {
+
+constexpr u32 kWidths[] = {400, 399, 320, 319};
+
+int failures = 0;
+
+template <typename Scalar, typename Simd, typename Output>
+void Compare(const std::string &kernel, const std::string &test_case, size_t iterations, Output &scalar_out, Output &simd_out, Scalar scalar, Simd simd) {
+    double scalar_ms = bench::Time(iterations, [&](size_t) { scalar(); });
+    double simd_ms = bench::Time(iterations, [&](size_t) { simd(); });
+
+    bench::Report(kernel + "_scalar", test_case, iterations, scalar_ms, bench::Checksum(scalar_out.data(), scalar_out.size() * sizeof(scalar_out[0])));
+    bench::Report(kernel + "_simd", test_case, iterations, simd_ms, bench::Checksum(simd_out.data(), simd_out.size() * sizeof(simd_out[0])));
+    fprintf(stderr, "%s %s: simd %.2fx scalar speed\n", kernel.c_str(), test_case.c_str(), scalar_ms / simd_ms);
+
+    if (scalar_out != simd_out) {
+        fprintf(stderr, "%s %s: scalar and simd outputs differ\n", kernel.c_str(), test_case.c_str());
+        failures++;
+    }
+}
+
+template <u32 N>
+void CompareBoxFilter(size_t iterations, std::mt19937 &rng, u32 width) {
+    u32 row_size = (width * 3 + 3) & ~3u;
+    std::vector<u8> rows(row_size * N);
+    for (auto &byte : rows) byte = rng();
+
+    u32 count = (width + N - 1) / N;
+    std::vector<u16> scalar_sums(width * 3), simd_sums(width * 3);
+    std::vector<u8> scalar_texels(count * 3), simd_texels(count * 3);
+    std::string test_case = std::to_string(width) + "px_" + std::to_string(N) + "x" + std::to_string(N);
+
+    for (u32 num_rows = 1; num_rows <= N; num_rows++) {
+        // Partial block rows happen once per image, only time the full ones
+        bmp_kernels::scalar::sum_rows(rows.data(), row_size, num_rows, width * 3, scalar_sums.data());
+        bmp_kernels::simd::sum_rows(rows.data(), row_size, num_rows, width * 3, simd_sums.data());
+        bmp_kernels::scalar::average_blocks<N>(scalar_sums.data(), width, num_rows, scalar_texels.data(), count);
+        bmp_kernels::simd::average_blocks<N>(scalar_sums.data(), width, num_rows, simd_texels.data(), count);
+
+        if (scalar_sums != simd_sums || scalar_texels != simd_texels) {
+            fprintf(stderr, "box filter %s over %u rows: scalar and simd outputs differ\n", test_case.c_str(), num_rows);
+            failures++;
+        }
+    }
+
+    Compare(
+        "sum_rows", test_case, iterations, scalar_sums, simd_sums,
+        [&] { bmp_kernels::scalar::sum_rows(rows.data(), row_size, N, width * 3, scalar_sums.data()); },
+        [&] { bmp_kernels::simd::sum_rows(rows.data(), row_size, N, width * 3, simd_sums.data()); });
+    Compare(
+        "average_blocks", test_case, iterations, scalar_texels, simd_texels,
+        [&] { bmp_kernels::scalar::average_blocks<N>(scalar_sums.data(), width, N, scalar_texels.data(), count); },
+        [&] { bmp_kernels::simd::average_blocks<N>(scalar_sums.data(), width, N, simd_texels.data(), count); });
+}
+
+// Swizzles a full screen worth of tiles from random rows, with a letterboxed column and row in every tile
+void CompareTiles(size_t iterations, std::mt19937 &rng, u32 width) {
+    u32 row_size = (width * 3 + 3) & ~3u;
+    std::vector<u8> band(row_size * 8 + sizeof(u32));
+    for (auto &byte : band) byte = rng();
+
+    const u8 *rows[8];
+    for (u32 y = 0; y < 8; y++) rows[y] = y == 5 ? nullptr : band.data() + y * row_size;
+
+    u32 tiles = width / 8;
+    std::vector<s32> columns(tiles * 8);
+    for (u32 x = 0; x < columns.size(); x++) columns[x] = x % 8 == 3 ? -1 : (rng() % width) * 3;
+
+    std::vector<u8> scalar_tiles(tiles * 64 * 3), simd_tiles(tiles * 64 * 3);
+    Compare(
+        "write_tile", std::to_string(width) + "px", iterations, scalar_tiles, simd_tiles,
+        [&] {
+            for (u32 t = 0; t < tiles; t++) bmp_kernels::scalar::write_tile(scalar_tiles.data() + t * 64 * 3, {rows, columns.data() + t * 8});
+        },
+        [&] {
+            for (u32 t = 0; t < tiles; t++) bmp_kernels::simd::write_tile(simd_tiles.data() + t * 64 * 3, {rows, columns.data() + t * 8});
+        });
+
+    for (auto &byte : scalar_tiles) byte = rng();
+    for (auto &byte : simd_tiles) byte = rng();
+    Compare(
+        "zero_tile", std::to_string(width) + "px", iterations, scalar_tiles, simd_tiles,
+        [&] {
+            for (u32 t = 0; t < tiles; t++) bmp_kernels::scalar::zero_tile(scalar_tiles.data() + t * 64 * 3);
+        },
+        [&] {
+            for (u32 t = 0; t < tiles; t++) bmp_kernels::simd::zero_tile(simd_tiles.data() + t * 64 * 3);
+        });
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000;
+
+    std::mt19937 rng(1);
+    bench::PrintHeader();
+
+    for (u32 width : kWidths) {
+        CompareTiles(iterations, rng, width);
+        CompareBoxFilter<2>(iterations, rng, width);
+        CompareBoxFilter<4>(iterations, rng, width);
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
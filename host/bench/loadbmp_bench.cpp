@@ -0,0 +1,286 @@
+// Decode + swizzle time of loadbmp_to_image over a synthetic BMP corpus, for full screen and thumbnail targets.
+// Every case is decoded with both resamplers, and the run fails if their outputs are not bit-identical.
+// Thumbnail targets are also decoded with the box filter used for the thumbnail cache.
+// Every layout of the corpus (top-down rows, larger headers, pixels after a gap) must decode like the plain bottom-up file,
+// and malformed headers must be rejected by loadbmp_probe and the decoders with the expected error.
+// Thumbnails decoded into a cell of an atlas page must match the ones decoded into their own texture.
+// Decoding must not allocate once warmed up, the run also fails if operator new is called inside a timed loop.
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string.h>
+
+#include <atomic>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "bmp_corpus.hpp"
+#include "io.hpp"
+#include "loadbmp.hpp"
+#include "thumbnail_atlas.hpp"
+#include "ui.hpp"
+
+// GCC pairs the replaced operator new with free() when inlining and warns about the mismatch
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+std::atomic<size_t> allocations = 0;
+
+void *operator new(size_t size) {
+    allocations++;
+    if (void *ptr = malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+namespace {
+
+struct Target {
+    const char *name;
+    u16 width;
+    u16 height;
+    bool thumbnail;
+};
+
+struct Resampler {
+    const char *name;
+    unsigned int id;
+};
+
+constexpr Resampler kResamplers[] = {
+    {"fixed", LOADBMP_RESAMPLE_FIXED},
+    {"float", LOADBMP_RESAMPLE_FLOAT},
+};
+
+constexpr Target kTargets[] = {
+    {"screen", ui::kTopScreenWidth, ui::kTopScreenHeight, false},
+    {"thumbnail", ui::kThumbnailWidth, ui::kThumbnailHeight, true},
+};
+
+// Times fn after one warm up call, counting the allocations made by the timed calls
+template <typename Fn>
+double TimeSteadyState(size_t iterations, size_t &allocated, Fn fn) {
+    fn(0);
+    size_t before = allocations;
+    double total_ms = bench::Time(iterations, fn);
+    allocated = allocations - before;
+    return total_ms;
+}
+
+// Header corruptions and the error they must be rejected with
+struct Corruption {
+    const char *name;
+    size_t offset;
+    std::vector<u8> bytes;
+    unsigned int error;
+};
+
+const Corruption kCorruptions[] = {
+    {"bad_signature", 0, {'X', 'M'}, LOADBMP_INVALID_SIGNATURE},
+    {"core_header", 14, {12, 0, 0, 0}, LOADBMP_INVALID_FILE_FORMAT},
+    {"pixels_inside_header", 10, {20, 0, 0, 0}, LOADBMP_INVALID_FILE_FORMAT},
+    {"zero_height", 22, {0, 0, 0, 0}, LOADBMP_INVALID_DIMENSIONS},
+    {"huge_width", 18, {0, 0, 0, 1}, LOADBMP_INVALID_DIMENSIONS},
+    {"8_bpp", 28, {8, 0}, LOADBMP_INVALID_BITS_PER_PIXEL},
+    {"rle8", 30, {1, 0, 0, 0}, LOADBMP_UNSUPPORTED_COMPRESSION},
+};
+
+std::string WriteCorrupted(const std::string &path, const Corruption &corruption) {
+    std::ifstream in(path, std::ios::binary);
+    std::vector<char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::copy(corruption.bytes.begin(), corruption.bytes.end(), file.begin() + corruption.offset);
+
+    std::string corrupted = path + "." + corruption.name + ".bmp";
+    std::ofstream(corrupted, std::ios::binary).write(file.data(), file.size());
+    return corrupted;
+}
+
+// Tiles of the texture of an image covered by its subtexture, in tile row order
+std::vector<u8> TargetTiles(C2D_Image image) {
+    bmp_target target = loadbmp_target(image);
+    std::vector<u8> tiles;
+    for (u32 tile_row = 0; tile_row < target.height / 8; tile_row++) {
+        const u8 *row = target.data + tile_row * target.tile_row_stride;
+        tiles.insert(tiles.end(), row, row + target.row_size);
+    }
+    return tiles;
+}
+
+void DeleteImage(C2D_Image image) {
+    C3D_TexDelete(image.tex);
+    delete image.tex;
+    delete image.subtex;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200;
+
+    bench::TempDir dir("screenshot_viewer_loadbmp_bench");
+    bench::PrintHeader();
+
+    int failures = 0;
+    for (const auto &spec : bench::kBmpCorpus) {
+        std::string path = bench::WriteBmp(dir.path(), spec).string();
+
+        for (const auto &target : kTargets) {
+            std::string test_case = std::string(spec.name) + "_to_" + target.name;
+            C2D_Image images[2];
+
+            for (int r = 0; r < 2; r++) {
+                images[r] = ui::CreateImage(target.width, target.height);
+
+                unsigned int error = LOADBMP_NO_ERROR;
+                size_t allocated = 0;
+                double total_ms =
+                    TimeSteadyState(iterations, allocated, [&](size_t) { error |= loadbmp_to_image(path.c_str(), images[r], kResamplers[r].id); });
+
+                if (error) {
+                    fprintf(stderr, "loadbmp_to_image failed for %s (error %u)\n", path.c_str(), error);
+                    failures++;
+                }
+                if (allocated) {
+                    fprintf(stderr, "loadbmp_to_image made %zu allocations decoding %s\n", allocated, path.c_str());
+                    failures++;
+                }
+
+                bench::Report(std::string("loadbmp_to_image_") + kResamplers[r].name, test_case, iterations, total_ms,
+                              bench::Checksum(images[r].tex->data, images[r].tex->size));
+            }
+
+            if (memcmp(images[0].tex->data, images[1].tex->data, images[0].tex->size) != 0) {
+                fprintf(stderr, "%s: fixed point and float resamplers differ\n", test_case.c_str());
+                failures++;
+            }
+
+            for (auto &image : images) DeleteImage(image);
+
+            if (target.thumbnail) {
+                C2D_Image image = ui::CreateImage(target.width, target.height);
+
+                unsigned int error = LOADBMP_NO_ERROR;
+                size_t allocated = 0;
+                double total_ms = TimeSteadyState(iterations, allocated, [&](size_t) { error |= loadbmp_to_thumbnail(path.c_str(), image); });
+
+                if (error) {
+                    fprintf(stderr, "loadbmp_to_thumbnail failed for %s (error %u)\n", path.c_str(), error);
+                    failures++;
+                }
+                if (allocated) {
+                    fprintf(stderr, "loadbmp_to_thumbnail made %zu allocations decoding %s\n", allocated, path.c_str());
+                    failures++;
+                }
+
+                bench::Report("loadbmp_to_thumbnail", test_case, iterations, total_ms, bench::Checksum(image.tex->data, image.tex->size));
+                DeleteImage(image);
+            }
+        }
+    }
+
+    for (const auto &spec : bench::kBmpCorpus) {
+        std::string expected_path = bench::WriteBmp(dir.path(), spec).string();
+
+        for (const auto &target : kTargets) {
+            C2D_Image expected = ui::CreateImage(target.width, target.height);
+            C2D_Image image = ui::CreateImage(target.width, target.height);
+            auto decode = [&](const char *path, C2D_Image img) { return target.thumbnail ? loadbmp_to_thumbnail(path, img) : loadbmp_to_image(path, img); };
+            decode(expected_path.c_str(), expected);
+
+            for (const auto &layout : bench::kBmpLayouts) {
+                std::string path = bench::WriteBmp(dir.path(), spec, 1, layout).string();
+                std::string test_case = std::string(spec.name) + "_" + layout.name + "_to_" + target.name;
+
+                unsigned int error = LOADBMP_NO_ERROR;
+                double total_ms = bench::Time(iterations, [&](size_t) { error |= decode(path.c_str(), image); });
+
+                if (error || memcmp(image.tex->data, expected.tex->data, image.tex->size) != 0) {
+                    fprintf(stderr, "%s: decodes differently from the bottom-up file (error %u)\n", test_case.c_str(), error);
+                    failures++;
+                }
+
+                bench::Report("loadbmp_layout", test_case, iterations, total_ms, bench::Checksum(image.tex->data, image.tex->size));
+            }
+
+            DeleteImage(expected);
+            DeleteImage(image);
+        }
+    }
+
+    // Thumbnails decoded into a cell of an atlas page must match the ones decoded into their own texture, and must not
+    // touch the rest of the page. The bmp of the thumbnail size goes through the native size copy.
+    {
+        constexpr bench::BmpSpec kThumbnailSpec = {"thumbnail_100x60", ui::kThumbnailWidth, ui::kThumbnailHeight};
+        std::string top_path = bench::WriteBmp(dir.path(), bench::kBmpCorpus[0], 5).string();
+        std::string thumbnail_path = bench::WriteBmp(dir.path(), kThumbnailSpec, 6).string();
+
+        struct AtlasCase {
+            const char *name;
+            const std::string &path;
+            bool box_filter;
+        };
+        const AtlasCase cases[] = {
+            {"box_filter", top_path, true},
+            {"resampler", top_path, false},
+            {"native_size", thumbnail_path, false},
+        };
+
+        screenshots::ThumbnailAtlas atlas(ui::kThumbnailWidth, ui::kThumbnailHeight, 16);
+        C2D_Image cell = atlas.Image(10);
+        C2D_Image expected = ui::CreateImage(ui::kThumbnailWidth, ui::kThumbnailHeight);
+
+        for (const auto &atlas_case : cases) {
+            auto decode = [&](C2D_Image img) {
+                return atlas_case.box_filter ? loadbmp_to_thumbnail(atlas_case.path.c_str(), img) : loadbmp_to_image(atlas_case.path.c_str(), img);
+            };
+
+            unsigned int error = decode(expected);
+            double total_ms = bench::Time(iterations, [&](size_t) { error |= decode(cell); });
+
+            std::vector<u8> tiles = TargetTiles(cell);
+            if (error || tiles != TargetTiles(expected)) {
+                fprintf(stderr, "atlas %s: cell decodes differently from a thumbnail texture (error %u)\n", atlas_case.name, error);
+                failures++;
+            }
+
+            // Every byte of the page outside the cell is still zero
+            size_t page_sum = 0;
+            for (size_t i = 0; i < cell.tex->size; i++) page_sum += static_cast<u8 *>(cell.tex->data)[i];
+            size_t cell_sum = 0;
+            for (u8 byte : tiles) cell_sum += byte;
+            if (page_sum != cell_sum) {
+                fprintf(stderr, "atlas %s: decoding wrote outside of the cell\n", atlas_case.name);
+                failures++;
+            }
+
+            bench::Report("loadbmp_atlas", atlas_case.name, iterations, total_ms, bench::Checksum(tiles.data(), tiles.size()));
+        }
+
+        DeleteImage(expected);
+    }
+
+    std::string probe_path = bench::WriteBmp(dir.path(), bench::kBmpCorpus[0]).string();
+    bmp_info info;
+    bench::Run("loadbmp_probe", bench::kBmpCorpus[0].name, iterations, [&](size_t) { loadbmp_probe(probe_path.c_str(), info); });
+
+    C2D_Image image = ui::CreateImage(ui::kTopScreenWidth, ui::kTopScreenHeight);
+    for (const auto &corruption : kCorruptions) {
+        std::string path = WriteCorrupted(probe_path, corruption);
+
+        unsigned int errors[] = {loadbmp_probe(path.c_str(), info), loadbmp_to_image(path.c_str(), image), loadbmp_to_thumbnail(path.c_str(), image)};
+        for (unsigned int error : errors) {
+            if (error != corruption.error) {
+                fprintf(stderr, "%s: expected error %u, got %u\n", corruption.name, corruption.error, error);
+                failures++;
+            }
+        }
+    }
+    DeleteImage(image);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
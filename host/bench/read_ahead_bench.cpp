@@ -0,0 +1,203 @@
+// Full screen decodes through a bandwidth-throttled file source, read directly or through ReadAheadThread.
+// A host decodes far faster than the console, so the decoder is also slowed down to a console-like cost by spinning
+// in proportion to the bytes it consumes. With read ahead the time per image should approach max(read, decode)
+// instead of read + decode. Then random seeks and reads through ReadAheadThread, many of them right after a read that
+// ends on a chunk boundary, are compared with the file, and seeks past its end have to fail like the source's.
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "bmp_corpus.hpp"
+#include "loadbmp.hpp"
+#include "threads/read_ahead_thread.hpp"
+#include "ui.hpp"
+
+namespace {
+
+// Models a block device: data is fetched in fixed size blocks and every block fetch blocks the calling thread
+// for a time proportional to its size, like a thread waiting on the SD card would
+class ThrottledReader : public bmp_reader {
+   private:
+    static constexpr size_t kBlockSize = 16 * 1024;
+
+    std::unique_ptr<bmp_reader> file = io::CreateReader(io::kStdio);
+    std::chrono::nanoseconds block_time;
+
+    std::vector<char> block = std::vector<char>(kBlockSize);
+    size_t block_offset = 0;
+    size_t block_size = 0;
+    size_t position = 0;
+
+    bool FetchBlock() {
+        block_offset = position / kBlockSize * kBlockSize;
+        if (!file->seek(block_offset)) return false;
+
+        block_size = file->read(block.data(), kBlockSize);
+        std::this_thread::sleep_for(block_time);
+        return block_size > 0;
+    }
+
+   public:
+    explicit ThrottledReader(double ns_per_byte) : block_time(static_cast<long long>(ns_per_byte * kBlockSize)) {}
+
+    bool open(const char *filename) override {
+        block_size = 0;
+        position = 0;
+        return file->open(filename);
+    }
+    void close() override { file->close(); }
+
+    size_t read(void *dst, size_t size) override {
+        size_t total = 0;
+        while (total < size) {
+            if (position < block_offset || position >= block_offset + block_size) {
+                if (!FetchBlock() || position >= block_offset + block_size) break;
+            }
+
+            size_t count = std::min(size - total, block_offset + block_size - position);
+            memcpy(static_cast<char *>(dst) + total, block.data() + (position - block_offset), count);
+            total += count;
+            position += count;
+        }
+        return total;
+    }
+    bool seek(size_t offset) override {
+        position = offset;
+        return true;
+    }
+    size_t tell() override { return position; }
+};
+
+// Spins for a fixed time per byte handed to the decoder, emulating a slower CPU decoding each band as it arrives
+class SlowDecodeReader : public bmp_reader {
+   private:
+    bmp_reader &reader;
+    double ns_per_byte;
+
+   public:
+    SlowDecodeReader(bmp_reader &reader, double ns_per_byte) : reader(reader), ns_per_byte(ns_per_byte) {}
+
+    bool open(const char *filename) override { return reader.open(filename); }
+    void close() override { reader.close(); }
+    size_t read(void *dst, size_t size) override {
+        size_t count = reader.read(dst, size);
+        auto end = std::chrono::steady_clock::now() + std::chrono::nanoseconds(static_cast<long long>(count * ns_per_byte));
+        while (std::chrono::steady_clock::now() < end) {
+        }
+        return count;
+    }
+    bool seek(size_t offset) override { return reader.seek(offset); }
+    size_t tell() override { return reader.tell(); }
+};
+
+// Seeks and reads through ReadAheadThread over an mmap source, returns the number of reads that differ from the file
+// and of seeks that did not fail or succeed like the source's
+size_t CheckSeeks(const std::string &path, size_t ops) {
+    std::string contents;
+    io::ReadFile(path, contents);
+
+    auto source = io::CreateReader(io::kMmap);
+    screenshots::threads::ReadAheadThread read_ahead(*source);
+    read_ahead.open(path.c_str());
+
+    constexpr size_t kChunkSize = 16 * 1024;
+    size_t errors = 0;
+    std::vector<char> buffer(3 * kChunkSize);
+    u32 random = 1;
+    auto next = [&](size_t range) {
+        random = random * 1103515245 + 12345;
+        return (random >> 8) % range;
+    };
+
+    for (size_t i = 0; i < ops; i++) {
+        // Up to a chunk past the end, or just before a chunk boundary so the read crosses it and the seek goes ahead
+        size_t offset = next(4) == 0 ? (next(contents.size() / kChunkSize) + 1) * kChunkSize - next(64) : next(contents.size() + kChunkSize);
+        bool seeked = read_ahead.seek(offset);
+        if (seeked != (offset <= contents.size())) errors++;
+        if (!seeked) continue;
+
+        size_t size = next(buffer.size());
+        size_t expected = std::min(size, contents.size() - offset);
+        if (read_ahead.read(buffer.data(), size) != expected || memcmp(buffer.data(), contents.data() + offset, expected) != 0) errors++;
+
+        // Into the chunk being read ahead, right after the read
+        size_t ahead = offset + expected + next(kChunkSize);
+        seeked = read_ahead.seek(ahead);
+        if (seeked != (ahead <= contents.size())) errors++;
+        if (seeked && (read_ahead.read(buffer.data(), 1) != (ahead < contents.size()) || (ahead < contents.size() && buffer[0] != contents[ahead]))) {
+            errors++;
+        }
+    }
+
+    read_ahead.close();
+    return errors;
+}
+
+void DeleteImage(C2D_Image image) {
+    C3D_TexDelete(image.tex);
+    delete image.tex;
+    delete image.subtex;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10;
+
+    bench::TempDir dir("screenshot_viewer_read_ahead_bench");
+    std::string path = bench::WriteBmp(dir.path(), bench::kBmpCorpus[0]).string();
+    size_t file_size = std::filesystem::file_size(path);
+
+    C2D_Image image = ui::CreateImage(ui::kTopScreenWidth, ui::kTopScreenHeight);
+    bench::PrintHeader();
+
+    int failures = 0;
+    auto decode = [&](bmp_reader &reader) {
+        if (loadbmp_to_image(reader, path.c_str(), image)) failures++;
+    };
+
+    auto unthrottled = io::CreateReader(io::kStdio);
+    bench::Run("read_ahead", "unthrottled", iterations, [&](size_t) { decode(*unthrottled); });
+
+    // Emulated decode time of a full screen image, and read time of the whole file as a multiple of it
+    constexpr double kDecodeMs = 20;
+    double decode_ns_per_byte = kDecodeMs * 1e6 / file_size;
+
+    for (double io_ratio : {0.5, 1.0, 2.0}) {
+        std::string test_case = "io_" + std::to_string(static_cast<int>(io_ratio * 100)) + "pct_of_decode";
+        ThrottledReader throttled(decode_ns_per_byte * io_ratio);
+
+        SlowDecodeReader direct(throttled, decode_ns_per_byte);
+        bench::Run("read_ahead", test_case + "_direct", iterations, [&](size_t) { decode(direct); });
+
+        screenshots::threads::ReadAheadThread read_ahead(throttled);
+        SlowDecodeReader pipelined(read_ahead, decode_ns_per_byte);
+        bench::Run("read_ahead", test_case + "_pipelined", iterations, [&](size_t) { decode(pipelined); });
+    }
+
+    std::string checksum = bench::Checksum(image.tex->data, image.tex->size);
+    loadbmp_to_image(path, image);
+    if (checksum != bench::Checksum(image.tex->data, image.tex->size)) {
+        fprintf(stderr, "read ahead decode differs from a direct decode\n");
+        failures++;
+    }
+
+    constexpr size_t kSeekOps = 20000;
+    size_t errors = CheckSeeks(path, kSeekOps);
+    if (errors > 0) {
+        fprintf(stderr, "%zu of %zu seeks and reads through read ahead differ from the file\n", errors, kSeekOps);
+        failures++;
+    }
+
+    DeleteImage(image);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
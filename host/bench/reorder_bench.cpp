@@ -0,0 +1,105 @@
+// Tag filter toggles on a large library once the thumbnails around the visible page are cached. Filtering down to
+// cached screenshots and back only re-targets the thumbnail thread at the new order, so the run fails if a toggle
+// loads any thumbnail again or if the visible page is not complete right after it.
+
+#include <3ds.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "bench.hpp"
+#include "bmp_corpus.hpp"
+#include "screenshots.hpp"
+#include "settings.hpp"
+#include "tags.hpp"
+
+namespace {
+
+constexpr size_t kThumbnailsPerPage = 9;
+constexpr size_t kToggles = 10;
+
+// Waits for the thumbnail thread to stop loading
+void WaitIdle() {
+    size_t loaded = screenshots::NumLoadedThumbnails();
+    for (int quiet = 0, waited = 0; quiet < 20 && waited < 2000; waited++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        size_t now = screenshots::NumLoadedThumbnails();
+        quiet = now == loaded ? quiet + 1 : 0;
+        loaded = now;
+    }
+}
+
+bool PageComplete(size_t page) {
+    for (size_t i = page * kThumbnailsPerPage; i < std::min(screenshots::Count(), (page + 1) * kThumbnailsPerPage); i++) {
+        if (!screenshots::HasThumbnail(screenshots::GetInfo(i))) return false;
+    }
+    return true;
+}
+
+void CreateScreenshotFiles(const std::filesystem::path &dir, size_t count) {
+    auto bmp = bench::WriteBmp(dir, bench::kBmpCorpus[0]);
+    for (size_t i = 0; i < count; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "2023-01-01_00-%02zu-%02zu.%03zu_top.bmp", (i / 60000) % 60, (i / 1000) % 60, i % 1000);
+        std::filesystem::create_hard_link(bmp, dir / name);
+    }
+    std::filesystem::remove(bmp);
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 5000;
+
+    bench::TempDir dir("screenshot_viewer_reorder_bench");
+    CreateScreenshotFiles(dir.path(), count);
+    settings::SetScreenshotsPath(dir.path().string());
+    settings::SetThumbnailCachePath((dir.path() / "thumbnails").string());
+
+    bench::PrintHeader();
+    int failures = 0;
+
+    screenshots::Init();
+    while (!PageComplete(0)) std::this_thread::yield();
+    WaitIdle();
+
+    // Every other cached screenshot gets the tag
+    std::set<std::string> names;
+    for (size_t i = 0; i < screenshots::Count(); i += 2) {
+        if (!screenshots::HasThumbnail(screenshots::GetInfo(i))) break;
+        names.insert(screenshots::GetInfo(i)->name);
+    }
+    tags::tag_ptr tag = tags::AddTag({"filter", C2D_Color32(0xFF, 0, 0, 0xFF)});
+    tags::ChangeScreenshotsTags(names, {tag}, {});
+    WaitIdle();
+
+    size_t loaded = screenshots::NumLoadedThumbnails();
+    size_t incomplete = 0;
+    double toggle_ms = 0;
+    for (size_t i = 0; i < kToggles; i++) {
+        toggle_ms += bench::Time(1, [&](size_t) {
+            if (i % 2 == 0) {
+                tags::ChangeTagsFilter({tag}, {});
+            } else {
+                tags::ChangeTagsFilter({}, {tag});
+            }
+        });
+        incomplete += !PageComplete(0);
+        WaitIdle();
+    }
+    bench::Report("filter_toggle", std::to_string(count) + "_screenshots_" + std::to_string(names.size()) + "_tagged", kToggles, toggle_ms);
+
+    size_t reloaded = screenshots::NumLoadedThumbnails() - loaded;
+    fprintf(stderr, "%zu thumbnails loaded again over %zu toggles, visible page incomplete after %zu\n", reloaded, kToggles, incomplete);
+    if (reloaded > 0 || incomplete > 0) {
+        fprintf(stderr, "toggling the filter reloaded cached thumbnails\n");
+        failures++;
+    }
+
+    screenshots::Exit();
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
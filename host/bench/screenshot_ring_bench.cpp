@@ -0,0 +1,189 @@
+// Browsing screenshots one by one like the arrow keys of the viewer, with a few rings of preloaded screenshots. After
+// each screenshot the user looks at it for a while, and the ring preloads its neighbours meanwhile. Steps are timed
+// against loading screenshots far away from the last one, and count as instant when several times faster. Every
+// screenshot handed out is checked against its files, again after the wait, so preloading never writes the one shown.
+// The run fails on a mismatch, or if a step forward or back was not preloaded: only turning back with a ring of 2 may
+// load. The times are only reported, the host may preempt the thread of a step.
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "bmp_corpus.hpp"
+#include "loadbmp.hpp"
+#include "screenshots.hpp"
+#include "settings.hpp"
+#include "ui.hpp"
+
+namespace {
+
+constexpr int kBufferCounts[] = {2, 3, 5};
+constexpr size_t kScreenshots = 60;
+// Distinct images, neighbours always differ
+constexpr size_t kImages = 12;
+constexpr size_t kForwardSteps = 30;
+constexpr size_t kBackSteps = 15;
+constexpr size_t kFarLoads = 9;
+constexpr auto kDwell = std::chrono::milliseconds(30);
+// A step is instant when it is this many times faster than the median far load
+constexpr double kInstantRatio = 4.0;
+
+std::string Tiles(C2D_Image image) {
+    bmp_target target = loadbmp_target(image);
+    std::string tiles;
+    for (u32 tile_row = 0; tile_row < target.height / 8; tile_row++) {
+        tiles.append(reinterpret_cast<const char *>(target.data + tile_row * target.tile_row_stride), target.row_size);
+    }
+    return tiles;
+}
+
+void DeleteImage(C2D_Image image) {
+    C3D_TexDelete(image.tex);
+    delete image.tex;
+    delete image.subtex;
+}
+
+// Texels of the top and bottom image of each image
+std::vector<std::string> CreateScreenshotFiles(const std::filesystem::path &dir) {
+    std::vector<std::string> expected;
+    C2D_Image top = ui::CreateImage(ui::kTopScreenWidth, ui::kTopScreenHeight);
+    C2D_Image bottom = ui::CreateImage(ui::kBottomScreenWidth, ui::kBottomScreenHeight);
+
+    std::vector<std::filesystem::path> images;
+    for (size_t i = 0; i < kImages; i++) {
+        images.push_back(bench::WriteBmp(dir, bench::kBmpCorpus[0], i + 1));
+        loadbmp_to_image(images.back().string(), top);
+        images.push_back(bench::WriteBmp(dir, bench::kBmpCorpus[1], i + 1));
+        loadbmp_to_image(images.back().string(), bottom);
+        expected.push_back(Tiles(top) + Tiles(bottom));
+    }
+
+    for (size_t i = 0; i < kScreenshots; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "2023-01-01_00-00-00.%03zu", i);
+        std::filesystem::create_hard_link(images[i % kImages * 2], dir / (std::string(name) + "_top.bmp"));
+        std::filesystem::create_hard_link(images[i % kImages * 2 + 1], dir / (std::string(name) + "_bot.bmp"));
+    }
+    for (auto &image : images) std::filesystem::remove(image);
+
+    DeleteImage(top);
+    DeleteImage(bottom);
+    return expected;
+}
+
+std::atomic<screenshots::screenshot_ptr> loaded_screenshot = nullptr;
+// Taken in the callback: on a host with a single core, the preloading that follows it delays this thread
+std::chrono::steady_clock::time_point loaded_time;
+
+void ScreenshotLoaded(screenshots::screenshot_ptr screenshot) {
+    loaded_time = std::chrono::steady_clock::now();
+    loaded_screenshot = screenshot;
+}
+
+// Loads a screenshot like the viewer, returns the time until the callback in microseconds
+double Open(size_t index, screenshots::screenshot_ptr &screenshot) {
+    loaded_screenshot = nullptr;
+    auto start = std::chrono::steady_clock::now();
+    screenshots::Load(screenshots::GetInfo(index), ScreenshotLoaded);
+    while (loaded_screenshot == nullptr) std::this_thread::yield();
+
+    screenshot = loaded_screenshot;
+    return std::chrono::duration<double, std::micro>(loaded_time - start).count();
+}
+
+struct Steps {
+    size_t instant = 0;
+    size_t count = 0;
+    double total_us = 0;
+};
+}  // namespace
+
+int main(int argc, char **argv) {
+    bench::TempDir dir("screenshot_viewer_screenshot_ring_bench");
+    auto expected = CreateScreenshotFiles(dir.path());
+    settings::SetScreenshotsPath(dir.path().string());
+    settings::SetThumbnailCachePath((dir.path() / "thumbnails").string());
+
+    bench::PrintHeader();
+    int failures = 0;
+    size_t mismatches = 0;
+
+    for (int buffers : kBufferCounts) {
+        settings::SetScreenshotBuffers(buffers);
+        screenshots::Init();
+
+        screenshots::screenshot_ptr screenshot;
+        auto check = [&](size_t index) {
+            mismatches += screenshot == nullptr || Tiles(screenshot->top) + Tiles(screenshot->bottom) != expected[index % kImages];
+        };
+
+        // The host may have a single core, the thumbnail thread is left idle so the times are the screenshot thread's
+        for (size_t i = 0; i < kScreenshots; i++) {
+            while (!screenshots::HasThumbnail(screenshots::GetInfo(i))) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        // Loads that no ring holds, each far from the one before
+        std::vector<double> far_us;
+        for (size_t i = 0; i < kFarLoads; i++) {
+            size_t index = (i * 23 + 7) % kScreenshots;
+            far_us.push_back(Open(index, screenshot));
+            check(index);
+            std::this_thread::sleep_for(kDwell);
+        }
+        std::sort(far_us.begin(), far_us.end());
+        double cold_us = far_us[far_us.size() / 2];
+
+        // Forward from the first screenshot, then back
+        Steps forward, back;
+        size_t index = 0;
+        Open(index, screenshot);
+        std::this_thread::sleep_for(kDwell);
+        size_t missed = screenshots::NumMissedScreenshots();
+        for (size_t step = 0; step < kForwardSteps + kBackSteps; step++) {
+            Steps &steps = step < kForwardSteps ? forward : back;
+            index += step < kForwardSteps ? 1 : -1;
+
+            double us = Open(index, screenshot);
+            check(index);
+            steps.count++;
+            steps.instant += us * kInstantRatio < cold_us;
+            steps.total_us += us;
+
+            std::this_thread::sleep_for(kDwell);
+            check(index);
+        }
+        missed = screenshots::NumMissedScreenshots() - missed;
+
+        screenshots::Exit();
+
+        std::string suffix = "_" + std::to_string(buffers) + "_buffers";
+        bench::Report("far", std::to_string(kScreenshots) + "_screenshots" + suffix, kFarLoads, cold_us * kFarLoads / 1000.0);
+        bench::Report("forward", std::to_string(kScreenshots) + "_screenshots" + suffix, forward.count, forward.total_us / 1000.0);
+        bench::Report("back", std::to_string(kScreenshots) + "_screenshots" + suffix, back.count, back.total_us / 1000.0);
+        fprintf(stderr, "%d buffers: %zu of %zu steps forward and %zu of %zu back instant, %zu not preloaded\n", buffers, forward.instant,
+                forward.count, back.instant, back.count, missed);
+
+        // A ring of 2 only holds the screenshot ahead, turning back loads once
+        if (missed > (buffers >= 3 ? 0 : 1)) {
+            fprintf(stderr, "a ring of %d buffers did not preload %zu steps\n", buffers, missed);
+            failures++;
+        }
+    }
+
+    if (mismatches > 0) {
+        fprintf(stderr, "%zu screenshots handed out or shown differ from their files\n", mismatches);
+        failures++;
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,157 @@
+// Replays a trace of the page the viewer shows every frame and measures how often the visible page has all its
+// thumbnails. The trace is replayed twice on a cold cache, once with the page only, which keeps the prefetch symmetric,
+// and once with the speed the viewer estimates, which moves it ahead of the scroll. The run fails if the hit rate
+// during fast scrolling is lower with the speed.
+//
+// The host decodes thumbnails many times faster than the console, so frames are replayed in a fraction of their time
+// (1 ms by default) for the decoder to fall behind a fast scroll like it does on the console. The thumbnail thread
+// weighs the speed against its own load times, so it is given the speed in host time.
+//
+// Usage: scroll_trace_bench [trace file] [frame time in us]
+// A trace file has the page shown in every frame, one per line. A built-in trace is used when none is given.
+
+#include <3ds.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "bmp_corpus.hpp"
+#include "screenshots.hpp"
+#include "settings.hpp"
+
+namespace {
+
+constexpr u32 kLinearHeapSize = 10 * 1024 * 1024;
+constexpr size_t kScreenshots = 900;
+constexpr size_t kThumbnailsPerPage = 9;
+constexpr size_t kRuns = 2;
+constexpr u64 kFrameTicks = SYSCLOCK_ARM11 / 60;
+// Frames count as fast scrolling from this speed, in pages per second
+constexpr float kFastScroll = 5.0f;
+
+// Holding R and L at different rates, with pauses
+std::vector<size_t> BuiltInTrace() {
+    struct Segment {
+        int pages;   // Pages to move, negative going back
+        int frames;  // Frames per page
+    };
+    constexpr Segment kSegments[] = {
+        {0, 30}, {60, 3}, {0, 30}, {-10, 8}, {0, 30}, {30, 2}, {0, 30}, {15, 6}, {0, 30},
+    };
+
+    std::vector<size_t> trace;
+    size_t page = 0;
+    for (const auto &segment : kSegments) {
+        int steps = std::max(1, std::abs(segment.pages));
+        for (int step = 0; step < steps; step++) {
+            if (segment.pages > 0) page++;
+            if (segment.pages < 0) page--;
+            for (int frame = 0; frame < segment.frames; frame++) trace.push_back(page);
+        }
+    }
+    return trace;
+}
+
+bool ReadTrace(const char *path, std::vector<size_t> &trace) {
+    std::ifstream file(path);
+    size_t page;
+    while (file >> page) trace.push_back(page);
+    return !trace.empty();
+}
+
+void CreateScreenshotFiles(const std::filesystem::path &dir) {
+    auto bmp = bench::WriteBmp(dir, bench::kBmpCorpus[0]);
+    for (size_t i = 0; i < kScreenshots; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "2023-01-01_00-00-%02zu.%03zu_top.bmp", i / 1000, i % 1000);
+        std::filesystem::create_hard_link(bmp, dir / name);
+    }
+    std::filesystem::remove(bmp);
+}
+
+struct HitRate {
+    size_t hits = 0;
+    size_t frames = 0;
+
+    double Percent() const { return frames ? 100.0 * hits / frames : 100.0; }
+};
+
+// Replays the trace on a cold cache and counts the frames showing the whole visible page, overall and while scrolling
+// fast
+void Replay(const std::vector<size_t> &trace, bool report_speed, std::chrono::microseconds frame_time, HitRate &all, HitRate &fast) {
+    screenshots::Init();
+
+    // Fast scrolling is told apart in console time
+    screenshots::ScrollTracker tracker, console_tracker;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < trace.size(); frame++) {
+        size_t page = std::min(trace[frame], (screenshots::Count() - 1) / kThumbnailsPerPage);
+        float speed = console_tracker.Update(page, (frame + 1) * kFrameTicks);
+        screenshots::SetScroll(page, report_speed ? tracker.Update(page, svcGetSystemTick()) : 0.0f);
+
+        bool visible = true;
+        for (size_t i = page * kThumbnailsPerPage; i < std::min(screenshots::Count(), (page + 1) * kThumbnailsPerPage); i++) {
+            visible = screenshots::HasThumbnail(screenshots::GetInfo(i)) && visible;
+        }
+
+        all.frames++;
+        all.hits += visible;
+        if (std::abs(speed) >= kFastScroll) {
+            fast.frames++;
+            fast.hits += visible;
+        }
+
+        std::this_thread::sleep_until(start + frame_time * (frame + 1));
+    }
+
+    screenshots::Exit();
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::vector<size_t> trace;
+    if (argc > 1 && !ReadTrace(argv[1], trace)) {
+        fprintf(stderr, "Could not read a trace from %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    if (trace.empty()) trace = BuiltInTrace();
+    std::chrono::microseconds frame_time(argc > 2 ? strtoul(argv[2], nullptr, 10) : 1000);
+
+    bench::TempDir dir("screenshot_viewer_scroll_trace_bench");
+    CreateScreenshotFiles(dir.path());
+    settings::SetScreenshotsPath(dir.path().string());
+    hostSetLinearHeapSize(kLinearHeapSize);
+
+    bench::PrintHeader();
+
+    // Modes alternate, so both see the same share of host noise
+    HitRate all[2], fast[2];
+    double total_ms[2] = {0, 0};
+    for (size_t run = 0; run < kRuns * 2; run++) {
+        bool report_speed = run % 2;
+        // A new store every run, so the thumbnails are decoded again
+        settings::SetThumbnailCachePath((dir.path() / ("thumbnails_" + std::to_string(run))).string());
+        total_ms[report_speed] += bench::Time(1, [&](size_t) { Replay(trace, report_speed, frame_time, all[report_speed], fast[report_speed]); });
+    }
+
+    for (int report_speed = 0; report_speed < 2; report_speed++) {
+        const char *mode = report_speed ? "velocity" : "symmetric";
+        bench::Report("replay", std::to_string(trace.size()) + "_frames_" + mode, kRuns * trace.size(), total_ms[report_speed]);
+        fprintf(stderr, "%s: visible page complete in %.1f%% of the frames, %.1f%% of %zu while scrolling fast\n", mode, all[report_speed].Percent(),
+                fast[report_speed].Percent(), fast[report_speed].frames);
+    }
+
+    if (fast[1].Percent() < fast[0].Percent()) {
+        fprintf(stderr, "the hit rate while scrolling fast is lower when the speed is reported\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+// Thumbnail cache scheduling and sizing on a small linear heap. Paging quickly has to load the visible page before the
+// rest of the previous plan. The cache has to pick its capacity from the free linear memory, evict once it is full
+// while scrolling through more screenshots than it holds, and give pages back when something else takes the memory it
+// left free. The events of the instrumentation hook are checked against that. The run fails if any of these does not
+// hold.
+
+#include <3ds.h>
+#include <citro3d.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "bmp_corpus.hpp"
+#include "screenshots.hpp"
+#include "settings.hpp"
+#include "thumbnail_atlas.hpp"
+#include "ui.hpp"
+
+namespace {
+
+// Room for the screenshot textures and about two atlas pages of RGB8 thumbnails
+constexpr u32 kLinearHeapSize = 10 * 1024 * 1024;
+constexpr size_t kScreenshots = 400;
+constexpr size_t kScrollStep = 50;
+constexpr size_t kThumbnailsPerPage = 9;
+
+using Event = std::pair<screenshots::ThumbnailCacheEvent, screenshots::ThumbnailCacheStats>;
+
+std::mutex events_mutex;
+std::vector<Event> events;
+
+void RecordEvent(screenshots::ThumbnailCacheEvent event, const screenshots::ThumbnailCacheStats &stats) {
+    std::lock_guard<std::mutex> lock(events_mutex);
+    events.emplace_back(event, stats);
+}
+
+// Events reported so far, the thumbnail thread may still be adding more
+std::vector<Event> Events() {
+    std::lock_guard<std::mutex> lock(events_mutex);
+    return events;
+}
+
+// Waits for the thumbnail thread to stop loading, for longer than it waits before releasing a page
+void WaitIdle() {
+    size_t loaded = screenshots::NumLoadedThumbnails();
+    for (int quiet = 0, waited = 0; quiet < 20 && waited < 2000; waited++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        size_t now = screenshots::NumLoadedThumbnails();
+        quiet = now == loaded ? quiet + 1 : 0;
+        loaded = now;
+    }
+}
+
+// Requests the thumbnails of a page like the viewer draws them and spins until they are loaded. Returns the number of
+// thumbnails the thread loaded up to the last check that still missed some, the loads done while this thread waits for
+// the host to schedule it again after the page is complete are not counted.
+size_t ShowPage(size_t page) {
+    size_t start = screenshots::NumLoadedThumbnails();
+    size_t loaded = start;
+    while (true) {
+        size_t now = screenshots::NumLoadedThumbnails();
+        bool visible = true;
+        for (size_t i = page * kThumbnailsPerPage; i < std::min(kScreenshots, (page + 1) * kThumbnailsPerPage); i++) {
+            visible = screenshots::HasThumbnail(screenshots::GetInfo(i)) && visible;
+        }
+        if (visible) break;
+        loaded = now;
+    }
+    return loaded - start;
+}
+
+void CreateScreenshotFiles(const std::filesystem::path &dir) {
+    auto bmp = bench::WriteBmp(dir, bench::kBmpCorpus[0]);
+    for (size_t i = 0; i < kScreenshots; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "2023-01-01_00-00-%02zu.%03zu_top.bmp", i / 1000, i % 1000);
+        std::filesystem::create_hard_link(bmp, dir / name);
+    }
+    std::filesystem::remove(bmp);
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    bench::TempDir dir("screenshot_viewer_thumbnail_cache_bench");
+    CreateScreenshotFiles(dir.path());
+    settings::SetScreenshotsPath(dir.path().string());
+    settings::SetThumbnailCachePath((dir.path() / "thumbnails").string());
+
+    hostSetLinearHeapSize(kLinearHeapSize);
+    screenshots::SetThumbnailCacheHook(RecordEvent);
+
+    bench::PrintHeader();
+    int failures = 0;
+
+    screenshots::Init();
+    auto [first_event, initial] = Events().at(0);
+
+    size_t page_size = screenshots::ThumbnailAtlas::PageSize(GPU_RGB8);
+    size_t per_page = screenshots::ThumbnailAtlas::CellsPerPage(ui::kThumbnailWidth, ui::kThumbnailHeight);
+    if (first_event != screenshots::kCacheCapacity || initial.budget >= kLinearHeapSize ||
+        initial.capacity != std::max<size_t>(1, initial.budget / page_size) * per_page || initial.capacity >= kScreenshots) {
+        fprintf(stderr, "unexpected startup capacity %zu for a budget of %zu bytes\n", initial.capacity, initial.budget);
+        failures++;
+    }
+    fprintf(stderr, "budget %zu KB, capacity %zu thumbnails\n", initial.budget / 1024, initial.capacity);
+
+    std::string test_case = std::to_string(kScreenshots) + "_screenshots_" + std::to_string(initial.capacity) + "_capacity";
+
+    // Paging quickly through thumbnails not decoded yet, the visible page has to come before the rest of the plan
+    size_t most_loaded = 0;
+    bench::Run("page_flip", test_case, 10, [&](size_t i) { most_loaded = std::max(most_loaded, ShowPage(i * 3)); });
+    if (most_loaded > 2 * kThumbnailsPerPage) {
+        fprintf(stderr, "%zu thumbnails loaded before the visible page\n", most_loaded);
+        failures++;
+    }
+    WaitIdle();
+
+    bench::Run("scroll", test_case, kScreenshots / kScrollStep, [](size_t i) {
+        screenshots::GetInfo(i * kScrollStep);
+        WaitIdle();
+    });
+
+    size_t evictions = 0;
+    for (auto &[event, stats] : Events()) {
+        if (stats.thumbnails > stats.capacity || stats.pages * per_page < stats.thumbnails) {
+            fprintf(stderr, "cache holds %zu thumbnails in %zu pages with a capacity of %zu\n", stats.thumbnails, stats.pages, stats.capacity);
+            failures++;
+            break;
+        }
+        if (event == screenshots::kCacheEviction) evictions = stats.evictions;
+    }
+    if (evictions == 0) {
+        fprintf(stderr, "no evictions reported\n");
+        failures++;
+    }
+    fprintf(stderr, "%zu evictions while scrolling\n", evictions);
+
+    // Something else takes the memory the cache left free, the cache has to give pages back on its next loads
+    std::vector<C3D_Tex> pressure;
+    while (linearSpaceFree() > 512 * 1024) {
+        pressure.emplace_back();
+        if (!C3D_TexInit(&pressure.back(), 256, 256, GPU_RGB8)) {
+            pressure.pop_back();
+            break;
+        }
+    }
+    size_t event_count = Events().size();
+    bench::Run("shrink", test_case, 2, [](size_t i) {
+        screenshots::GetInfo(i * kScrollStep);
+        WaitIdle();
+    });
+
+    auto after = Events();
+    auto shrink = std::find_if(after.begin() + event_count, after.end(), [](const Event &e) { return e.first == screenshots::kCacheCapacity; });
+    if (shrink == after.end() || shrink->second.capacity >= initial.capacity || after.back().second.pages != 1) {
+        fprintf(stderr, "cache did not shrink under memory pressure\n");
+        failures++;
+    } else {
+        fprintf(stderr, "shrunk to %zu thumbnails in %zu pages\n", after.back().second.capacity, after.back().second.pages);
+    }
+
+    for (auto &tex : pressure) C3D_TexDelete(&tex);
+    screenshots::Exit();
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
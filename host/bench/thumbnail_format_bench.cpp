@@ -0,0 +1,130 @@
+// Encoding time and quality of the compressed thumbnail formats. Thumbnails of the corpus are decoded with the box
+// filter, encoded into an atlas cell of each format and decoded back; the PSNR against the RGB8 thumbnail is printed
+// to stderr. The run fails if a format loses more than its expected quality, if RGB8 is not lossless, or if the decoders
+// accept a texture that is not RGB8.
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "bmp_corpus.hpp"
+#include "loadbmp.hpp"
+#include "thumbnail_atlas.hpp"
+#include "thumbnail_format.hpp"
+#include "ui.hpp"
+
+namespace {
+
+using screenshots::ThumbnailFormat;
+
+struct FormatCase {
+    const char *name;
+    ThumbnailFormat format;
+    double min_psnr;
+};
+
+// RGB565 rounds every channel to 5 or 6 bits. ETC1 only modulates the brightness of each pixel, while the three
+// channels of the corpus change in different directions, a worst case for it.
+constexpr FormatCase kFormats[] = {
+    {"rgb8", screenshots::kThumbnailRGB8, INFINITY},
+    {"rgb565", screenshots::kThumbnailRGB565, 40.0},
+    {"etc1", screenshots::kThumbnailETC1, 24.0},
+};
+
+// PSNR of the thumbnail texels of two RGB8 images, infinite when they are identical
+double Psnr(C2D_Image expected, C2D_Image image) {
+    bmp_target expected_target = loadbmp_target(expected);
+    bmp_target image_target = loadbmp_target(image);
+
+    double squared_error = 0;
+    size_t samples = 0;
+    for (u32 y = 0; y < expected.subtex->height; y++) {
+        for (u32 x = 0; x < expected.subtex->width; x++) {
+            u32 offset = (y >> 3) * expected_target.tile_row_stride + (x >> 3) * 64 * LOADBMP_RGB;
+            u32 texel = ((x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2) | ((x & 4) << 2) | ((y & 4) << 3)) * LOADBMP_RGB;
+            u32 image_offset = (y >> 3) * image_target.tile_row_stride + (x >> 3) * 64 * LOADBMP_RGB;
+            for (u32 c = 0; c < LOADBMP_RGB; c++, samples++) {
+                double error = static_cast<double>(expected_target.data[offset + texel + c]) - image_target.data[image_offset + texel + c];
+                squared_error += error * error;
+            }
+        }
+    }
+
+    if (squared_error == 0) return INFINITY;
+    return 10.0 * log10(255.0 * 255.0 / (squared_error / samples));
+}
+
+void DeleteImage(C2D_Image image) {
+    C3D_TexDelete(image.tex);
+    delete image.tex;
+    delete image.subtex;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 50;
+
+    bench::TempDir dir("screenshot_viewer_thumbnail_format_bench");
+    bench::PrintHeader();
+
+    int failures = 0;
+    C2D_Image thumbnail = ui::CreateImage(ui::kThumbnailWidth, ui::kThumbnailHeight);
+    C2D_Image decoded = ui::CreateImage(ui::kThumbnailWidth, ui::kThumbnailHeight);
+
+    for (const auto &format_case : kFormats) {
+        // An interior cell, so encoding has to follow the tile rows of the page
+        screenshots::ThumbnailAtlas atlas(ui::kThumbnailWidth, ui::kThumbnailHeight, 16, screenshots::TextureColor(format_case.format));
+        C2D_Image cell = atlas.Image(10);
+
+        for (const auto &spec : bench::kBmpCorpus) {
+            std::string path = bench::WriteBmp(dir.path(), spec).string();
+            std::string test_case = std::string(spec.name) + "_to_" + format_case.name;
+
+            if (loadbmp_to_thumbnail(path.c_str(), thumbnail) != LOADBMP_NO_ERROR) {
+                fprintf(stderr, "loadbmp_to_thumbnail failed for %s\n", path.c_str());
+                failures++;
+                continue;
+            }
+
+            // The decoders only write RGB8
+            unsigned int expected_error = format_case.format == screenshots::kThumbnailRGB8 ? LOADBMP_NO_ERROR : LOADBMP_UNSUPPORTED_TEXTURE_FORMAT;
+            if (loadbmp_to_thumbnail(path.c_str(), cell) != expected_error || loadbmp_to_image(path.c_str(), cell) != expected_error) {
+                fprintf(stderr, "%s: decoding straight into the cell did not return error %u\n", test_case.c_str(), expected_error);
+                failures++;
+            }
+
+            double total_ms = bench::Time(iterations, [&](size_t) { screenshots::EncodeImage(thumbnail, cell); });
+            screenshots::DecodeImage(cell, decoded);
+
+            double psnr = Psnr(thumbnail, decoded);
+            if (psnr < format_case.min_psnr) {
+                fprintf(stderr, "%s: PSNR %.2f dB, expected at least %.2f dB\n", test_case.c_str(), psnr, format_case.min_psnr);
+                failures++;
+            }
+
+            bmp_target target = loadbmp_target(cell);
+            std::vector<u8> tiles;
+            for (u32 tile_row = 0; tile_row < target.height / 8; tile_row++) {
+                tiles.insert(tiles.end(), target.data + tile_row * target.tile_row_stride, target.data + tile_row * target.tile_row_stride + target.row_size);
+            }
+
+            bench::Report("encode_thumbnail", test_case, iterations, total_ms, bench::Checksum(tiles.data(), tiles.size()));
+            fprintf(stderr, "%s: PSNR %.2f dB\n", test_case.c_str(), psnr);
+        }
+
+        fprintf(stderr, "%s: %zu thumbnails per %zu KB page\n", format_case.name,
+                static_cast<size_t>(screenshots::ThumbnailAtlas::CellsPerPage(ui::kThumbnailWidth, ui::kThumbnailHeight)),
+                screenshots::ThumbnailAtlas::PageSize(screenshots::TextureColor(format_case.format)) / 1024);
+    }
+
+    DeleteImage(thumbnail);
+    DeleteImage(decoded);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
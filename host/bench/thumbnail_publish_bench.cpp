@@ -0,0 +1,145 @@
+// Thumbnails the UI thread draws while the cache evicts and reloads them on several decode workers. The main thread
+// plays the UI, jumping between pages of a cache of a single atlas page so the page it leaves is evicted right away.
+// Every frame it gets the thumbnails of the visible page, and the next frame it checks the texels of the ones it got
+// against the thumbnail of their screenshot decoded up front, standing in for the GPU that draws a frame while the
+// next one is prepared. Now and then the frame right after a jump stalls, with the thumbnails of the page left still
+// being drawn while the thread evicts them.
+// The run fails if a drawn thumbnail is ever half written or belongs to another screenshot. The longest GetThumbnail
+// call is printed to stderr, it never waits on the thumbnail thread.
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "bmp_corpus.hpp"
+#include "loadbmp.hpp"
+#include "screenshots.hpp"
+#include "settings.hpp"
+#include "ui.hpp"
+
+namespace {
+
+// Room for the screenshot textures and a single atlas page of RGB8 thumbnails
+constexpr u32 kLinearHeapSize = 7 * 1024 * 1024;
+constexpr u32 kCores = 4;
+constexpr size_t kScreenshots = 400;
+// Distinct images, a reused slot almost always gets another image than the one it held
+constexpr size_t kImages = 31;
+constexpr size_t kThumbnailsPerPage = 9;
+constexpr size_t kJumps = 150;
+constexpr size_t kFramesPerPage = 4;
+// Every that many frames, on the first frame of a page, a frame takes kStall to draw
+constexpr size_t kStallFrames = kFramesPerPage * 12;
+constexpr auto kStall = std::chrono::milliseconds(80);
+
+struct DrawnThumbnail {
+    const C2D_Image *image;
+    size_t index;
+};
+
+std::string Tiles(C2D_Image image) {
+    bmp_target target = loadbmp_target(image);
+    std::string tiles;
+    for (u32 tile_row = 0; tile_row < target.height / 8; tile_row++) {
+        tiles.append(reinterpret_cast<const char *>(target.data + tile_row * target.tile_row_stride), target.row_size);
+    }
+    return tiles;
+}
+
+// Thumbnail texels of each image, decoded like the thumbnail thread does
+std::vector<std::string> CreateScreenshotFiles(const std::filesystem::path &dir) {
+    std::vector<std::string> expected;
+    C2D_Image thumbnail = ui::CreateImage(ui::kThumbnailWidth, ui::kThumbnailHeight);
+
+    std::vector<std::filesystem::path> images;
+    for (size_t i = 0; i < kImages; i++) {
+        images.push_back(bench::WriteBmp(dir, bench::kBmpCorpus[0], i + 1));
+        if (settings::SmoothThumbnails()) {
+            loadbmp_to_thumbnail(images.back().c_str(), thumbnail);
+        } else {
+            loadbmp_to_image(images.back().c_str(), thumbnail);
+        }
+        expected.push_back(Tiles(thumbnail));
+    }
+
+    for (size_t i = 0; i < kScreenshots; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "2023-01-01_00-00-00.%03zu_top.bmp", i);
+        std::filesystem::create_hard_link(images[i % kImages], dir / name);
+    }
+    for (auto &image : images) std::filesystem::remove(image);
+
+    C3D_TexDelete(thumbnail.tex);
+    delete thumbnail.tex;
+    delete thumbnail.subtex;
+    return expected;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    bench::TempDir dir("screenshot_viewer_thumbnail_publish_bench");
+    auto expected = CreateScreenshotFiles(dir.path());
+    settings::SetScreenshotsPath(dir.path().string());
+    settings::SetThumbnailCachePath((dir.path() / "thumbnails").string());
+
+    hostSetLinearHeapSize(kLinearHeapSize);
+    hostSetNumCores(kCores);
+
+    bench::PrintHeader();
+    screenshots::Init();
+
+    size_t pages = (kScreenshots + kThumbnailsPerPage - 1) / kThumbnailsPerPage;
+    size_t drawn = 0, torn = 0;
+    double longest_us = 0;
+    std::vector<DrawnThumbnail> frames[2];
+    u32 random = 1;
+    size_t page = 0;
+
+    double total_ms = bench::Time(kJumps * kFramesPerPage, [&](size_t frame) {
+        if (frame % kFramesPerPage == 0) {
+            random = random * 1103515245 + 12345;
+            page = (random >> 16) % pages;
+        }
+
+        auto &current = frames[frame % 2];
+        auto &previous = frames[(frame + 1) % 2];
+        current.clear();
+        for (size_t i = page * kThumbnailsPerPage; i < std::min(kScreenshots, (page + 1) * kThumbnailsPerPage); i++) {
+            screenshots::info_ptr info = screenshots::GetInfo(i);
+
+            auto start = std::chrono::steady_clock::now();
+            const C2D_Image *thumbnail = screenshots::GetThumbnail(info);
+            longest_us = std::max(longest_us, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+            if (thumbnail) current.push_back({thumbnail, i});
+        }
+
+        // The GPU draws the previous frame
+        std::this_thread::sleep_for(frame % kStallFrames == 0 ? std::chrono::microseconds(kStall) : std::chrono::microseconds(500));
+        for (auto &thumbnail : previous) {
+            drawn++;
+            torn += Tiles(*thumbnail.image) != expected[thumbnail.index % kImages];
+        }
+
+        screenshots::EndFrame();
+    });
+
+    bench::Report("draw", std::to_string(kScreenshots) + "_screenshots_" + std::to_string(kCores) + "_workers", kJumps * kFramesPerPage, total_ms);
+    fprintf(stderr, "%zu thumbnails drawn, %zu loaded, longest GetThumbnail %.1f us\n", drawn, screenshots::NumLoadedThumbnails(), longest_us);
+
+    screenshots::Exit();
+
+    if (drawn == 0 || torn > 0) {
+        fprintf(stderr, "%zu of %zu drawn thumbnails were half written or of another screenshot\n", torn, drawn);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+// Thumbnail store costs: decoding and saving thumbnails on a first launch against loading them back on the next one.
+// The run fails if a stored thumbnail differs from the decoded one, if a changed screenshot is not decoded again, or
+// if compaction or reopening the store loses thumbnails, or if a corrupt index is not discarded.
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "bmp_corpus.hpp"
+#include "io.hpp"
+#include "loadbmp.hpp"
+#include "thumbnail_atlas.hpp"
+#include "thumbnail_store.hpp"
+#include "ui.hpp"
+
+namespace {
+
+using screenshots::ThumbnailStore;
+
+int failures = 0;
+
+struct Screenshot {
+    std::string name;
+    std::string path;
+    std::string checksum;
+};
+
+// Checksum of the tiles of the thumbnail only, the rest of the atlas page is not written
+std::string ThumbnailChecksum(C2D_Image image) {
+    bmp_target target = loadbmp_target(image);
+    std::vector<u8> tiles;
+    for (u32 tile_row = 0; tile_row < target.height / 8; tile_row++) {
+        const u8 *row = target.data + tile_row * target.tile_row_stride;
+        tiles.insert(tiles.end(), row, row + target.row_size);
+    }
+    return bench::Checksum(tiles.data(), tiles.size());
+}
+
+// Loads a screenshot from the store, checking it matches the decoded thumbnail
+bool Load(ThumbnailStore &store, const Screenshot &screenshot, C2D_Image image, const char *step) {
+    ThumbnailStore::FileKey key;
+    if (!store.Load(screenshot.name, screenshot.path, image, key)) return false;
+
+    if (ThumbnailChecksum(image) != screenshot.checksum) {
+        fprintf(stderr, "%s: stored thumbnail of %s differs from the decoded one\n", step, screenshot.name.c_str());
+        failures++;
+    }
+    return true;
+}
+
+void Expect(bool condition, const char *what) {
+    if (!condition) {
+        fprintf(stderr, "%s\n", what);
+        failures++;
+    }
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200;
+
+    bench::TempDir dir("screenshot_viewer_thumbnail_store_bench");
+    std::string store_path = (dir.path() / "thumbnails").string();
+    bench::PrintHeader();
+
+    std::vector<Screenshot> screenshots;
+    for (size_t i = 0; i < count; i++) {
+        auto path = bench::WriteBmp(dir.path(), bench::kBmpCorpus[0], i + 1);
+        screenshots.push_back({path.stem().string(), path.string(), ""});
+    }
+
+    // A cell inside an atlas page, whose tiles are not contiguous in the texture
+    screenshots::ThumbnailAtlas atlas(ui::kThumbnailWidth, ui::kThumbnailHeight, 16);
+    C2D_Image image = atlas.Image(10);
+    auto reader = io::CreateReader();
+    std::string test_case = std::to_string(count) + "_thumbnails";
+
+    {
+        ThumbnailStore store(store_path, ui::kThumbnailWidth, ui::kThumbnailHeight, GPU_RGB8, 1);
+        bench::Run("decode_and_save", test_case, count, [&](size_t i) {
+            ThumbnailStore::FileKey key;
+            if (store.Load(screenshots[i].name, screenshots[i].path, image, key)) {
+                fprintf(stderr, "%s found in an empty store\n", screenshots[i].name.c_str());
+                failures++;
+            }
+            if (loadbmp_to_thumbnail(*reader, screenshots[i].path.c_str(), image) != LOADBMP_NO_ERROR) failures++;
+            store.Save(screenshots[i].name, key, image);
+            screenshots[i].checksum = ThumbnailChecksum(image);
+        });
+    }
+
+    {
+        ThumbnailStore *store = nullptr;
+        bench::Run("open", test_case, 1, [&](size_t) { store = new ThumbnailStore(store_path, ui::kThumbnailWidth, ui::kThumbnailHeight, GPU_RGB8, 1); });
+
+        size_t hits = 0;
+        bench::Run("load", test_case, count, [&](size_t i) { hits += Load(*store, screenshots[i], image, "load"); });
+        Expect(hits == count, "reopened store is missing thumbnails");
+
+        // A screenshot replaced by another file is decoded again
+        std::filesystem::last_write_time(screenshots[0].path, std::filesystem::last_write_time(screenshots[0].path) + std::chrono::hours(1));
+        ThumbnailStore::FileKey key;
+        Expect(!store->Load(screenshots[0].name, screenshots[0].path, image, key), "changed screenshot loaded from the store");
+        Expect(store->Count() == count - 1, "changed screenshot kept in the store");
+
+        // Thumbnails of deleted screenshots are dropped and their slots compacted
+        std::set<std::string> names;
+        for (size_t i = 0; i < count; i += 2) names.insert(screenshots[i].name);
+        store->Retain(names);
+
+        size_t moves = 0;
+        double compact_ms = bench::Time(1, [&](size_t) {
+            while (store->Compact()) moves++;
+        });
+        bench::Report("compact", test_case + "_" + std::to_string(moves) + "_moves", 1, compact_ms);
+
+        Expect(store->Count() == names.size() - 1, "retain kept thumbnails of deleted screenshots");
+        Expect(store->NumSlots() == store->Count(), "compaction left holes");
+        hits = 0;
+        for (const auto &screenshot : screenshots) hits += Load(*store, screenshot, image, "compact");
+        Expect(hits == store->Count(), "compaction lost thumbnails");
+
+        size_t retained = store->Count();
+        delete store;
+
+        ThumbnailStore reopened(store_path, ui::kThumbnailWidth, ui::kThumbnailHeight, GPU_RGB8, 1);
+        Expect(reopened.Count() == retained && reopened.NumSlots() == retained, "compacted store reopened differently");
+    }
+
+    {
+        // An index whose count does not match its size is discarded, even a count too large to allocate
+        std::string index_path = store_path + ".idx";
+        std::filesystem::copy_file(index_path, index_path + ".bak");
+
+        FILE *index = fopen(index_path.c_str(), "r+b");
+        u32 count = UINT32_MAX;
+        fseek(index, 8, SEEK_SET);
+        fwrite(&count, sizeof(count), 1, index);
+        fclose(index);
+        {
+            ThumbnailStore corrupt(store_path, ui::kThumbnailWidth, ui::kThumbnailHeight, GPU_RGB8, 1);
+            Expect(corrupt.Count() == 0, "index with a corrupt count loaded");
+        }
+
+        std::filesystem::copy_file(index_path + ".bak", index_path, std::filesystem::copy_options::overwrite_existing);
+        std::filesystem::resize_file(index_path, std::filesystem::file_size(index_path) - 1);
+        {
+            ThumbnailStore truncated(store_path, ui::kThumbnailWidth, ui::kThumbnailHeight, GPU_RGB8, 1);
+            Expect(truncated.Count() == 0, "truncated index loaded");
+        }
+    }
+
+    {
+        // A store written with another thumbnail filter is discarded
+        ThumbnailStore other(store_path, ui::kThumbnailWidth, ui::kThumbnailHeight, GPU_RGB8, 0);
+        Expect(other.Count() == 0, "store of another variant reused");
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,68 @@
+// Host stand-in for the parts of libctru used by the core modules.
+// Only what screenshots.cpp, tags.cpp, settings.cpp and loadbmp.hpp need is provided.
+
+#ifndef HOST_3DS_H_
+#define HOST_3DS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+typedef u32 Handle;
+typedef s32 Result;
+typedef s32 LightLock;
+
+typedef struct Thread_tag *Thread;
+typedef void (*ThreadFunc)(void *);
+
+#define U64_MAX UINT64_MAX
+#define CUR_THREAD_HANDLE 0xFFFF8000
+
+#define SYSCLOCK_ARM11 268111856
+
+typedef enum {
+    RESET_ONESHOT = 0,
+    RESET_STICKY = 1,
+    RESET_PULSE = 2,
+} ResetType;
+
+typedef struct {
+    u16 px;
+    u16 py;
+} touchPosition;
+
+Result svcCreateEvent(Handle *event, ResetType reset_type);
+Result svcSignalEvent(Handle handle);
+Result svcClearEvent(Handle handle);
+Result svcWaitSynchronization(Handle handle, s64 nanoseconds);
+Result svcCloseHandle(Handle handle);
+Result svcGetThreadPriority(s32 *out, Handle handle);
+void svcSleepThread(s64 ns);
+u64 svcGetSystemTick();
+
+// Fails for a core_id past the host cores, like the console does for the cores the application may not use
+Thread threadCreate(ThreadFunc entrypoint, void *arg, size_t stack_size, int prio, int core_id, bool detached);
+Result threadJoin(Thread thread, u64 timeout_ns);
+void threadFree(Thread thread);
+
+void LightLock_Init(LightLock *lock);
+void LightLock_Lock(LightLock *lock);
+void LightLock_Unlock(LightLock *lock);
+
+u32 linearSpaceFree();
+
+// Host only: size of the simulated linear heap textures are allocated from
+void hostSetLinearHeapSize(u32 size);
+// Host only: cores threadCreate accepts, the host's by default
+void hostSetNumCores(u32 cores);
+
+#endif  // HOST_3DS_H_
@@ -0,0 +1,25 @@
+// Host stand-in for the parts of citro2d used by the core modules.
+
+#ifndef HOST_CITRO2D_H_
+#define HOST_CITRO2D_H_
+
+#include "3ds.h"
+#include "citro3d.h"
+
+typedef struct {
+    u16 width;
+    u16 height;
+    float left;
+    float top;
+    float right;
+    float bottom;
+} Tex3DS_SubTexture;
+
+typedef struct {
+    C3D_Tex *tex;
+    const Tex3DS_SubTexture *subtex;
+} C2D_Image;
+
+constexpr u32 C2D_Color32(u8 r, u8 g, u8 b, u8 a) { return r | (g << (u32)8) | (b << (u32)16) | (a << (u32)24); }
+
+#endif  // HOST_CITRO2D_H_
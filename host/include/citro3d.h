@@ -0,0 +1,48 @@
+// Host stand-in for the parts of citro3d used by the core modules.
+// Textures live in plain heap memory with the same tiled layout the PICA200 expects.
+
+#ifndef HOST_CITRO3D_H_
+#define HOST_CITRO3D_H_
+
+#include "3ds.h"
+
+typedef enum {
+    GPU_RGBA8 = 0x0,
+    GPU_RGB8 = 0x1,
+    GPU_RGBA5551 = 0x2,
+    GPU_RGB565 = 0x3,
+    GPU_RGBA4 = 0x4,
+    GPU_LA8 = 0x5,
+    GPU_HILO8 = 0x6,
+    GPU_L8 = 0x7,
+    GPU_A8 = 0x8,
+    GPU_LA4 = 0x9,
+    GPU_L4 = 0xA,
+    GPU_A4 = 0xB,
+    GPU_ETC1 = 0xC,
+    GPU_ETC1A4 = 0xD,
+} GPU_TEXCOLOR;
+
+typedef enum {
+    GPU_CLAMP_TO_EDGE = 0x0,
+    GPU_CLAMP_TO_BORDER = 0x1,
+    GPU_REPEAT = 0x2,
+    GPU_MIRRORED_REPEAT = 0x3,
+} GPU_TEXTURE_WRAP_PARAM;
+
+typedef struct {
+    void *data;
+    GPU_TEXCOLOR fmt;
+    size_t size;
+    u16 height;
+    u16 width;
+    u32 param;
+    u32 border;
+} C3D_Tex;
+
+bool C3D_TexInit(C3D_Tex *tex, u16 width, u16 height, GPU_TEXCOLOR format);
+void C3D_TexDelete(C3D_Tex *tex);
+void C3D_TexFlush(C3D_Tex *tex);
+void C3D_TexSetWrap(C3D_Tex *tex, GPU_TEXTURE_WRAP_PARAM wrap_s, GPU_TEXTURE_WRAP_PARAM wrap_t);
+
+#endif  // HOST_CITRO3D_H_
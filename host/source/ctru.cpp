@@ -0,0 +1,251 @@
+// pthread / condition_variable backed implementation of the libctru and citro3d calls declared in host/include.
+
+#include <3ds.h>
+#include <citro3d.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+struct Event {
+    std::mutex mutex;
+    std::condition_variable cond;
+    ResetType reset_type;
+    bool signaled = false;
+};
+
+std::mutex handles_mutex;
+std::map<Handle, std::shared_ptr<Event>> events;
+Handle next_handle = 1;
+
+std::shared_ptr<Event> GetEvent(Handle handle) {
+    std::lock_guard<std::mutex> lock(handles_mutex);
+    auto it = events.find(handle);
+    return it == events.end() ? nullptr : it->second;
+}
+
+constexpr Result kInvalidHandle = static_cast<Result>(0xD8E007F7);
+constexpr Result kTimeout = static_cast<Result>(0x09401BFE);
+
+const auto start_time = std::chrono::steady_clock::now();
+
+// Textures count against a linear heap about the size an Old 3DS application gets, so running out of it can be tested
+std::atomic<size_t> linear_heap_size = 32 * 1024 * 1024;
+std::atomic<size_t> linear_heap_used = 0;
+
+std::atomic<u32> num_cores = std::max(1u, std::thread::hardware_concurrency());
+
+size_t TexelBits(GPU_TEXCOLOR format) {
+    switch (format) {
+        case GPU_RGBA8:
+            return 32;
+        case GPU_RGB8:
+            return 24;
+        case GPU_RGBA5551:
+        case GPU_RGB565:
+        case GPU_RGBA4:
+        case GPU_LA8:
+        case GPU_HILO8:
+            return 16;
+        case GPU_L8:
+        case GPU_A8:
+        case GPU_LA4:
+        case GPU_ETC1A4:
+            return 8;
+        default:
+            return 4;
+    }
+}
+}  // namespace
+
+// Threads are held to the stack threadCreate asks for, scaled for the larger frames of a 64 bit host. The stack given
+// is at least PTHREAD_STACK_MIN and filled with kStackFill, and a thread that used more than its share of it aborts the
+// run when it returns, so a thread that would overflow its stack on the console fails the host runs. A guard page
+// below the stack catches the overflows that go further.
+constexpr size_t kHostStackScale = 2;
+constexpr u8 kStackFill = 0xA5;
+
+struct Thread_tag {
+    pthread_t thread;
+    bool joinable;
+    ThreadFunc entrypoint;
+    void *arg;
+    size_t stack_limit;  // Scaled stack size asked for
+    u8 *mapping;         // Guard page then the stack
+    size_t mapping_size;
+};
+
+void *ThreadStart(void *arg) {
+    Thread thread = static_cast<Thread>(arg);
+    thread->entrypoint(thread->arg);
+
+    // The stack grows down, the lowest byte written sets how much was used
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    const u8 *stack = thread->mapping + page_size;
+    size_t stack_size = thread->mapping_size - page_size;
+    size_t unused = 0;
+    while (unused < stack_size && stack[unused] == kStackFill) unused++;
+    if (stack_size - unused > thread->stack_limit) {
+        fprintf(stderr, "a thread used %zu bytes of stack, more than the %zu it was created with on a 64 bit host\n", stack_size - unused,
+                thread->stack_limit);
+        abort();
+    }
+    return nullptr;
+}
+
+Result svcCreateEvent(Handle *event, ResetType reset_type) {
+    auto ev = std::make_shared<Event>();
+    ev->reset_type = reset_type;
+
+    std::lock_guard<std::mutex> lock(handles_mutex);
+    *event = next_handle++;
+    events[*event] = ev;
+    return 0;
+}
+
+Result svcSignalEvent(Handle handle) {
+    auto ev = GetEvent(handle);
+    if (!ev) return kInvalidHandle;
+
+    {
+        std::lock_guard<std::mutex> lock(ev->mutex);
+        ev->signaled = true;
+    }
+    ev->cond.notify_all();
+    return 0;
+}
+
+Result svcClearEvent(Handle handle) {
+    auto ev = GetEvent(handle);
+    if (!ev) return kInvalidHandle;
+
+    std::lock_guard<std::mutex> lock(ev->mutex);
+    ev->signaled = false;
+    return 0;
+}
+
+Result svcWaitSynchronization(Handle handle, s64 nanoseconds) {
+    auto ev = GetEvent(handle);
+    if (!ev) return kInvalidHandle;
+
+    std::unique_lock<std::mutex> lock(ev->mutex);
+    if (nanoseconds < 0) {
+        ev->cond.wait(lock, [&] { return ev->signaled; });
+    } else if (!ev->cond.wait_for(lock, std::chrono::nanoseconds(nanoseconds), [&] { return ev->signaled; })) {
+        return kTimeout;
+    }
+
+    if (ev->reset_type == RESET_ONESHOT) ev->signaled = false;
+    return 0;
+}
+
+Result svcCloseHandle(Handle handle) {
+    std::lock_guard<std::mutex> lock(handles_mutex);
+    return events.erase(handle) ? 0 : kInvalidHandle;
+}
+
+Result svcGetThreadPriority(s32 *out, Handle handle) {
+    *out = 0x30;
+    return 0;
+}
+
+void svcSleepThread(s64 ns) { std::this_thread::sleep_for(std::chrono::nanoseconds(ns)); }
+
+u64 svcGetSystemTick() {
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time).count();
+    return static_cast<u64>(elapsed) * (SYSCLOCK_ARM11 / 1000000) / 1000;
+}
+
+Thread threadCreate(ThreadFunc entrypoint, void *arg, size_t stack_size, int prio, int core_id, bool detached) {
+    // -2 is the default core of the process, -1 any core
+    if (core_id >= 0 && static_cast<u32>(core_id) >= num_cores) return nullptr;
+
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t limit = stack_size * kHostStackScale;
+    size_t host_stack_size = (std::max<size_t>(PTHREAD_STACK_MIN, limit) + page_size - 1) / page_size * page_size;
+
+    void *mapping = mmap(nullptr, page_size + host_stack_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) return nullptr;
+    mprotect(mapping, page_size, PROT_NONE);
+    memset(static_cast<u8 *>(mapping) + page_size, kStackFill, host_stack_size);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, static_cast<u8 *>(mapping) + page_size, host_stack_size);
+
+    Thread thread = new Thread_tag{{}, !detached, entrypoint, arg, limit, static_cast<u8 *>(mapping), page_size + host_stack_size};
+    int error = pthread_create(&thread->thread, &attr, ThreadStart, thread);
+    pthread_attr_destroy(&attr);
+    if (error) {
+        munmap(mapping, page_size + host_stack_size);
+        delete thread;
+        return nullptr;
+    }
+
+    if (detached) pthread_detach(thread->thread);
+    return thread;
+}
+
+Result threadJoin(Thread thread, u64 timeout_ns) {
+    if (thread->joinable) pthread_join(thread->thread, nullptr);
+    thread->joinable = false;
+    return 0;
+}
+
+void threadFree(Thread thread) {
+    munmap(thread->mapping, thread->mapping_size);
+    delete thread;
+}
+
+void LightLock_Init(LightLock *lock) { __atomic_store_n(lock, 0, __ATOMIC_RELAXED); }
+
+void LightLock_Lock(LightLock *lock) {
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) std::this_thread::yield();
+}
+
+void LightLock_Unlock(LightLock *lock) { __atomic_store_n(lock, 0, __ATOMIC_RELEASE); }
+
+u32 linearSpaceFree() { return linear_heap_used < linear_heap_size ? linear_heap_size - linear_heap_used : 0; }
+
+void hostSetLinearHeapSize(u32 size) { linear_heap_size = size; }
+
+void hostSetNumCores(u32 cores) { num_cores = cores; }
+
+bool C3D_TexInit(C3D_Tex *tex, u16 width, u16 height, GPU_TEXCOLOR format) {
+    tex->width = width;
+    tex->height = height;
+    tex->fmt = format;
+    tex->size = static_cast<size_t>(width) * height * TexelBits(format) / 8;
+    tex->param = 0;
+    tex->border = 0;
+    tex->data = nullptr;
+    if (tex->size > linearSpaceFree()) return false;
+
+    tex->data = aligned_alloc(0x80, (tex->size + 0x7F) & ~static_cast<size_t>(0x7F));
+    if (tex->data) linear_heap_used += tex->size;
+    return tex->data != nullptr;
+}
+
+void C3D_TexDelete(C3D_Tex *tex) {
+    if (tex->data) linear_heap_used -= tex->size;
+    free(tex->data);
+    tex->data = nullptr;
+}
+
+void C3D_TexFlush(C3D_Tex *tex) {}
+
+void C3D_TexSetWrap(C3D_Tex *tex, GPU_TEXTURE_WRAP_PARAM wrap_s, GPU_TEXTURE_WRAP_PARAM wrap_t) {}
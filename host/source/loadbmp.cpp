@@ -0,0 +1,4 @@
+// On the console the implementation is emitted by main.cpp, which is not part of the host build.
+
+#define LOADBMP_IMPLEMENTATION
+#include <loadbmp.hpp>
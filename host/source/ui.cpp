@@ -0,0 +1,35 @@
+// Host replacement for source/ui.cpp: only image creation is needed by the core modules.
+
+#include "ui.hpp"
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <string.h>
+
+#include <bit>
+
+namespace ui {
+
+C2D_Image CreateImage(u16 width, u16 height) {
+    C3D_Tex *tex = new C3D_Tex;
+    Tex3DS_SubTexture *subtex = new Tex3DS_SubTexture;
+
+    subtex->width = static_cast<u16>(width);
+    subtex->height = static_cast<u16>(height);
+
+    u16 width_pow2 = std::bit_ceil(subtex->width);
+    u16 height_pow2 = std::bit_ceil(subtex->height);
+
+    subtex->top = 1.0f;
+    subtex->left = 0.0f;
+    subtex->right = subtex->width / static_cast<float>(width_pow2);
+    subtex->bottom = 1.0f - subtex->height / static_cast<float>(height_pow2);
+
+    C3D_TexInit(tex, width_pow2, height_pow2, GPU_RGB8);
+    tex->border = 0xFFFFFFFF;
+    C3D_TexSetWrap(tex, GPU_CLAMP_TO_BORDER, GPU_CLAMP_TO_BORDER);
+    memset(tex->data, 0, tex->size);
+
+    return C2D_Image({tex, subtex});
+}
+}  // namespace ui
@@ -0,0 +1,219 @@
+#ifndef BMP_KERNELS_HPP_
+#define BMP_KERNELS_HPP_
+
+#include <3ds.h>
+#include <string.h>
+
+#include <array>
+
+#if defined(__ARM_FEATURE_SIMD32)
+#include <arm_acle.h>
+#endif
+
+// Pixel kernels of the bmp decoders. Every kernel has a portable scalar path and a path written against the ARMv6 SIMD
+// instructions, which the decoders use. Both give identical output. Off the console the ARMv6 instructions are emulated
+// with plain integer code, so the SIMD path can be checked against the scalar one on the host.
+namespace bmp_kernels {
+
+constexpr u32 kTexelSize = 3;
+
+// Position of each texel of an 8x8 texture tile in memory (Morton) order, as (y << 3) | x
+constexpr std::array<u8, 64> kTileTexels = [] {
+    std::array<u8, 64> texels{};
+    for (u32 y = 0; y < 8; y++) {
+        for (u32 x = 0; x < 8; x++) {
+            u32 offset = (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2) | ((x & 4) << 2) | ((y & 4) << 3);
+            texels[offset] = (y << 3) | x;
+        }
+    }
+    return texels;
+}();
+
+// Rows and columns (byte offsets in a row, -1 for letterbox) of the source pixels of a tile, a null row is letterbox
+struct TileSource {
+    const u8 *const *rows;
+    const s32 *columns;
+};
+
+// Offset of the source pixel of each texel of a tile in memory order, from the pixel at the top left of the tile,
+// for rows RowStride bytes apart (negative for bottom-up rows)
+template <s32 RowStride>
+constexpr std::array<s32, 64> kTileSourceOffsets = [] {
+    std::array<s32, 64> offsets{};
+    for (u32 i = 0; i < 64; i++) offsets[i] = (kTileTexels[i] >> 3) * RowStride + (kTileTexels[i] & 7) * kTexelSize;
+    return offsets;
+}();
+
+namespace scalar {
+
+// Writes the 64 texels of a tile, zero for letterbox
+inline void write_tile(u8 *tile, TileSource src) {
+    for (u32 i = 0; i < 64; i++, tile += kTexelSize) {
+        const u8 *row = src.rows[kTileTexels[i] >> 3];
+        s32 column = src.columns[kTileTexels[i] & 7];
+        if (row == nullptr || column < 0) {
+            tile[0] = 0;
+            tile[1] = 0;
+            tile[2] = 0;
+        } else {
+            tile[0] = row[column];
+            tile[1] = row[column + 1];
+            tile[2] = row[column + 2];
+        }
+    }
+}
+
+// Writes a tile whose source pixels are all inside the image, without column or letterbox lookups
+template <s32 RowStride>
+void copy_tile(u8 *tile, const u8 *src) {
+    for (u32 i = 0; i < 64; i++, tile += kTexelSize) {
+        const u8 *pixel = src + kTileSourceOffsets<RowStride>[i];
+        tile[0] = pixel[0];
+        tile[1] = pixel[1];
+        tile[2] = pixel[2];
+    }
+}
+
+inline void zero_tile(u8 *tile) {
+    for (u32 i = 0; i < 64 * kTexelSize; i++) tile[i] = 0;
+}
+
+// Per byte sums of num_rows rows of size bytes, num_rows must be at most 257 so sums fit 16 bits
+inline void sum_rows(const u8 *src, u32 stride, u32 num_rows, u32 size, u16 *sums) {
+    for (u32 i = 0; i < size; i++) sums[i] = src[i];
+    for (u32 row = 1; row < num_rows; row++) {
+        const u8 *row_src = src + row * stride;
+        for (u32 i = 0; i < size; i++) sums[i] += row_src[i];
+    }
+}
+
+// Averages blocks of N pixels of per byte column sums over num_rows rows, rounding to nearest.
+// The last block is partial when width is not a multiple of N.
+template <u32 N>
+void average_blocks(const u16 *sums, u32 width, u32 num_rows, u8 *texels, u32 count) {
+    for (u32 x = 0; x < count; x++, texels += kTexelSize) {
+        u32 pixels = width - x * N < N ? width - x * N : N;
+        u32 samples = pixels * num_rows;
+        for (u32 c = 0; c < kTexelSize; c++) {
+            u32 sum = 0;
+            for (u32 i = 0; i < pixels; i++) sum += sums[(x * N + i) * kTexelSize + c];
+            // A constant divisor for full blocks lets the compiler turn the division into a shift
+            texels[c] = samples == N * N ? (sum + N * N / 2) / (N * N) : (sum + samples / 2) / samples;
+        }
+    }
+}
+}  // namespace scalar
+
+namespace simd {
+
+#if defined(__ARM_FEATURE_SIMD32)
+inline u32 uxtab16(u32 acc, u32 x) { return __uxtab16(acc, x); }
+inline u32 uadd16(u32 a, u32 b) { return __uadd16(a, b); }
+inline u32 ror8(u32 x) { return __ror(x, 8); }
+#else
+// Adds bytes 0 and 2 of x to the low and high halfwords of acc
+inline u32 uxtab16(u32 acc, u32 x) { return ((acc + (x & 0xFF)) & 0xFFFF) | ((acc & 0xFFFF0000) + (x & 0xFF0000)); }
+// Adds the low and high halfwords separately
+inline u32 uadd16(u32 a, u32 b) { return ((a + b) & 0xFFFF) | ((a & 0xFFFF0000) + (b & 0xFFFF0000)); }
+inline u32 ror8(u32 x) { return (x >> 8) | (x << 24); }
+#endif
+
+inline u32 load32(const u8 *src) {
+    u32 word;
+    memcpy(&word, src, sizeof(word));
+    return word;
+}
+
+inline void store32(u8 *dst, u32 word) { memcpy(dst, &word, sizeof(word)); }
+
+// Texels are copied with one unaligned word load and store each: the extra byte written lands on the next texel in
+// memory, which is written right after. The last texel of the tile is copied bytewise to stay inside it.
+// Source rows must be readable one byte past the last pixel.
+inline void write_tile(u8 *tile, TileSource src) {
+    for (u32 i = 0; i < 64; i++, tile += kTexelSize) {
+        const u8 *row = src.rows[kTileTexels[i] >> 3];
+        s32 column = src.columns[kTileTexels[i] & 7];
+        u32 texel = row == nullptr || column < 0 ? 0 : load32(row + column);
+        if (i < 63) {
+            store32(tile, texel);
+        } else {
+            tile[0] = texel;
+            tile[1] = texel >> 8;
+            tile[2] = texel >> 16;
+        }
+    }
+}
+
+// Packed copies like write_tile, the source must be readable one byte past the last pixel
+template <s32 RowStride>
+void copy_tile(u8 *tile, const u8 *src) {
+    for (u32 i = 0; i < 63; i++, tile += kTexelSize) store32(tile, load32(src + kTileSourceOffsets<RowStride>[i]));
+
+    const u8 *pixel = src + kTileSourceOffsets<RowStride>[63];
+    tile[0] = pixel[0];
+    tile[1] = pixel[1];
+    tile[2] = pixel[2];
+}
+
+inline void zero_tile(u8 *tile) {
+    for (u32 i = 0; i < 64 * kTexelSize; i += 4) store32(tile + i, 0);
+}
+
+// Sums four bytes at a time in two halfword accumulators with UXTAB16, one for the even bytes and one for the odd ones
+inline void sum_rows(const u8 *src, u32 stride, u32 num_rows, u32 size, u16 *sums) {
+    u32 i = 0;
+    for (; i + 4 <= size; i += 4) {
+        u32 even = 0, odd = 0;
+        for (u32 row = 0; row < num_rows; row++) {
+            u32 word = load32(src + row * stride + i);
+            even = uxtab16(even, word);
+            odd = uxtab16(odd, ror8(word));
+        }
+
+        // Interleave back to byte order (PKHBT/PKHTB)
+        u32 low = (even & 0xFFFF) | (odd << 16);
+        u32 high = (even >> 16) | (odd & 0xFFFF0000);
+        memcpy(sums + i, &low, sizeof(low));
+        memcpy(sums + i + 2, &high, sizeof(high));
+    }
+
+    scalar::sum_rows(src + i, stride, num_rows, size - i, sums + i);
+}
+
+// Blocks of 4 pixels are 12 column sums, added as halfword pairs with UADD16: with the sums loaded as the words
+// (s0 s1) (s2 s3) (s4 s5) (s6 s7) (s8 s9) (s10 s11), a = w0 + w3, b = w1 + w4 and c = w2 + w5 hold every
+// channel sum in two halves. Other block sizes and the partial last block use the scalar path.
+template <u32 N>
+void average_blocks(const u16 *sums, u32 width, u32 num_rows, u8 *texels, u32 count) {
+    u32 x = 0;
+    if constexpr (N == 4) {
+        u32 samples = N * num_rows;
+        u32 full_blocks = width / N < count ? width / N : count;
+        for (; x < full_blocks; x++, sums += N * kTexelSize, texels += kTexelSize) {
+            u32 w[6];
+            memcpy(w, sums, sizeof(w));
+            u32 a = uadd16(w[0], w[3]);
+            u32 b = uadd16(w[1], w[4]);
+            u32 c = uadd16(w[2], w[5]);
+
+            u32 blue = (a & 0xFFFF) + (b >> 16);
+            u32 green = (a >> 16) + (c & 0xFFFF);
+            u32 red = (b & 0xFFFF) + (c >> 16);
+            if (samples == N * N) {
+                texels[0] = (blue + N * N / 2) / (N * N);
+                texels[1] = (green + N * N / 2) / (N * N);
+                texels[2] = (red + N * N / 2) / (N * N);
+            } else {
+                texels[0] = (blue + samples / 2) / samples;
+                texels[1] = (green + samples / 2) / samples;
+                texels[2] = (red + samples / 2) / samples;
+            }
+        }
+    }
+
+    scalar::average_blocks<N>(sums, width - x * N, num_rows, texels, count - x);
+}
+}  // namespace simd
+}  // namespace bmp_kernels
+
+#endif  // BMP_KERNELS_HPP_
@@ -0,0 +1,43 @@
+#ifndef IO_HPP_
+#define IO_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace io {
+
+enum Backend {
+    kStdio,   // newlib/libc streams with a buffer of the given block size
+    kNative,  // Aligned block reads straight from the FS service, console only
+    kMmap,    // Whole file mapped into memory, host only
+};
+
+constexpr size_t kDefaultBlockSize = 64 * 1024;
+
+// Byte source the loaders read files through
+class Reader {
+   public:
+    virtual ~Reader() {}
+
+    virtual bool open(const char *filename) = 0;
+    virtual void close() = 0;
+    // Returns the number of bytes read, less than size only at the end of the file or on error
+    virtual size_t read(void *dst, size_t size) = 0;
+    virtual bool seek(size_t offset) = 0;
+    virtual size_t tell() = 0;
+};
+
+// Backends not available on the current platform fall back to kStdio
+std::unique_ptr<Reader> CreateReader(Backend backend, size_t block_size = kDefaultBlockSize);
+std::unique_ptr<Reader> CreateReader();
+
+void SetDefaultBackend(Backend backend, size_t block_size = kDefaultBlockSize);
+
+bool ReadFile(const std::string &path, std::string &contents);
+// Names of the files (not directories) in path, in directory order
+bool ListFiles(const std::string &path, std::vector<std::string> &names);
+}  // namespace io
+
+#endif  // IO_HPP_
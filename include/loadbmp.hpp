@@ -51,9 +51,22 @@
 
 #define LOADBMP_INVALID_SIGNATURE 5
 #define LOADBMP_INVALID_BITS_PER_PIXEL 6
+#define LOADBMP_INVALID_DIMENSIONS 7
+#define LOADBMP_UNSUPPORTED_COMPRESSION 8
+#define LOADBMP_UNSUPPORTED_TEXTURE_FORMAT 9
 
 #define LOADBMP_RGB 3
 
+// Resamplers
+#define LOADBMP_RESAMPLE_FIXED 0
+#define LOADBMP_RESAMPLE_FLOAT 1
+
+// Downscale factor handled by the thumbnail box filter
+#define LOADBMP_THUMBNAIL_DOWNSCALE 4
+
+// Larger bmps are rejected by the header parser, before any row buffer is sized for them
+#define LOADBMP_MAX_DIMENSION 4096
+
 #ifdef LOADBMP_IMPLEMENTATION
 #define LOADBMP_API
 #else
@@ -61,119 +74,658 @@
 #endif
 
 #include <citro2d.h>
+#include <stdio.h>
 
-#include <functional>
+#include <array>
 #include <string>
 
-LOADBMP_API unsigned int loadbmp_to_image(std::string filename, C2D_Image img);
+#include "io.hpp"
+
+// Byte source the decoders read bmp files through
+typedef io::Reader bmp_reader;
+
+// Layout of a bmp, parsed from its file header and BITMAPINFOHEADER (or a later version of it)
+struct bmp_info {
+    u32 width;
+    u32 height;
+    u16 bits_per_pixel;
+    u32 pixel_offset;  // bfOffBits, start of the pixel rows in the file
+    bool top_down;     // Negative biHeight, rows stored from the top of the image
+};
+
+// Tiles of the texture of an image covered by its subtexture. Decoders only write these tiles, so images can share a
+// texture (e.g. thumbnails packed in an atlas) as long as their subtextures do not share tiles.
+struct bmp_target {
+    u8 *data;             // Top left tile
+    u32 width;            // Texels, a multiple of 8
+    u32 height;           // Texels, a multiple of 8
+    u32 row_size;         // Bytes of the tiles of one tile row of the target
+    u32 tile_row_stride;  // Bytes from one tile row of the texture to the next
+};
+
+LOADBMP_API bmp_target loadbmp_target(C2D_Image img);
+
+// Offset of each texel inside an 8x8 texture tile, indexed by (y * 8 + x).
+// The PICA200 stores the texels of a tile in Morton (Z) order.
+constexpr std::array<u8, 64> kTileOffsets = [] {
+    std::array<u8, 64> offsets{};
+    for (u32 y = 0; y < 8; y++) {
+        for (u32 x = 0; x < 8; x++) {
+            offsets[y * 8 + x] = (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2) | ((x & 4) << 2) | ((y & 4) << 3);
+        }
+    }
+    return offsets;
+}();
+
+// Reads only the 54 bytes of headers. Fails on anything the decoders cannot handle (not 24 bpp,
+// compressed, oversized), so bad files are rejected before reading their pixels.
+LOADBMP_API unsigned int loadbmp_probe(const char *filename, bmp_info &info);
+LOADBMP_API unsigned int loadbmp_probe(bmp_reader &reader, const char *filename, bmp_info &info);
+
+// Decode straight into the texture of img, which must be GPU_RGB8. Once the per-thread scratch buffers have grown to the largest bmp,
+// decoding does not touch the heap; the std::string overloads only forward the path.
+LOADBMP_API unsigned int loadbmp_to_image(const char *filename, C2D_Image img, unsigned int resampler = LOADBMP_RESAMPLE_FIXED);
+LOADBMP_API unsigned int loadbmp_to_image(bmp_reader &reader, const char *filename, C2D_Image img, unsigned int resampler = LOADBMP_RESAMPLE_FIXED);
+LOADBMP_API unsigned int loadbmp_to_image(const std::string &filename, C2D_Image img, unsigned int resampler = LOADBMP_RESAMPLE_FIXED);
+// Also returns the layout of the bmp in info, whenever its headers could be read
+LOADBMP_API unsigned int loadbmp_to_image(bmp_reader &reader, const char *filename, C2D_Image img, bmp_info &info,
+                                          unsigned int resampler = LOADBMP_RESAMPLE_FIXED);
+
+// Downscales by averaging LOADBMP_THUMBNAIL_DOWNSCALE x LOADBMP_THUMBNAIL_DOWNSCALE blocks while streaming the file.
+// Falls back to loadbmp_to_image when the bmp is not exactly that many times larger than the image.
+LOADBMP_API unsigned int loadbmp_to_thumbnail(const char *filename, C2D_Image img);
+LOADBMP_API unsigned int loadbmp_to_thumbnail(bmp_reader &reader, const char *filename, C2D_Image img);
+LOADBMP_API unsigned int loadbmp_to_thumbnail(const std::string &filename, C2D_Image img);
+
+// Downscales an image already decoded by loadbmp_to_image into img, tile to tile, without reading the file again.
+// src must be LOADBMP_THUMBNAIL_DOWNSCALE times the size of img. Blocks are averaged when smooth is set and sampled at
+// their top left texel otherwise, which gives the texels loadbmp_to_thumbnail and loadbmp_to_image give for a bmp of
+// the size of src.
+LOADBMP_API unsigned int loadbmp_image_to_thumbnail(C2D_Image src, C2D_Image img, bool smooth);
 
 #ifdef LOADBMP_IMPLEMENTATION
 
-#include <stdio.h>  /* fopen(), fread(), fclose() */
-#include <string.h> /* memset()*/
+#include <string.h> /* memset(), memcpy() */
 
 #include <algorithm>
+#include <array>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "bmp_kernels.hpp"
+
+// The SIMD kernels are only used where the ARMv6 instructions exist, elsewhere they would be emulated
+#if defined(__ARM_FEATURE_SIMD32)
+namespace loadbmp_kernels = bmp_kernels::simd;
+#else
+namespace loadbmp_kernels = bmp_kernels::scalar;
+#endif
+
 struct bmp_buffer {
     u32 width;
     u32 height;
     u32 channels;
     u32 padding;
-    char *data;
+    bool top_down;
 };
 
 constexpr u32 next_multiple_of_4(u32 x) { return ((x + 3) & ~0x03); }
 
-LOADBMP_API unsigned int loadbmp(std::string filename, std::function<unsigned int(bmp_buffer bmp)> callback) {
-    FILE *f = fopen(filename.c_str(), "rb");
+constexpr u16 loadbmp_u16(const u8 *bytes) { return bytes[0] | (bytes[1] << 8); }
+constexpr u32 loadbmp_u32(const u8 *bytes) { return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<u32>(bytes[3]) << 24); }
+
+// Parses the file header and the BITMAPINFOHEADER at the start of the reader
+LOADBMP_API unsigned int loadbmp_read_info(bmp_reader &reader, bmp_info &info) {
+    constexpr u32 kFileHeaderSize = 14;
+    constexpr u32 kInfoHeaderSize = 40;
+    constexpr u32 kCompressionRGB = 0;
+    constexpr u32 kCompressionBitfields = 3;
 
-    if (!f) return LOADBMP_FILE_NOT_FOUND;
+    u8 header[kFileHeaderSize + kInfoHeaderSize];
+    if (reader.read(header, sizeof(header)) != sizeof(header)) {
+        return LOADBMP_INVALID_FILE_FORMAT;
+    }
 
-    u8 bmp_file_header[14];
-    u8 bmp_info_header[40];
+    if ((header[0] != 'B') || (header[1] != 'M')) {
+        return LOADBMP_INVALID_SIGNATURE;
+    }
 
-    u32 w, h, c, num_bytes, padding;
+    const u8 *info_header = header + kFileHeaderSize;
+    u32 info_size = loadbmp_u32(info_header);
+    s32 width = static_cast<s32>(loadbmp_u32(info_header + 4));
+    s32 height = static_cast<s32>(loadbmp_u32(info_header + 8));
+    u16 planes = loadbmp_u16(info_header + 12);
+    u32 compression = loadbmp_u32(info_header + 16);
 
-    memset(bmp_file_header, 0, sizeof(bmp_file_header));
-    memset(bmp_info_header, 0, sizeof(bmp_info_header));
+    info.bits_per_pixel = loadbmp_u16(info_header + 14);
+    info.pixel_offset = loadbmp_u32(header + 10);
 
-    if (fread(bmp_file_header, sizeof(bmp_file_header), 1, f) == 0) {
-        fclose(f);
+    // BITMAPCOREHEADER (OS/2) files have a 12 byte header with 16 bit dimensions and are not supported
+    if (info_size < kInfoHeaderSize || planes != 1 || info.pixel_offset < kFileHeaderSize + info_size) {
         return LOADBMP_INVALID_FILE_FORMAT;
     }
 
-    if (fread(bmp_info_header, sizeof(bmp_info_header), 1, f) == 0) {
-        fclose(f);
-        return LOADBMP_INVALID_FILE_FORMAT;
+    if (width <= 0 || height == 0 || width > LOADBMP_MAX_DIMENSION || height > LOADBMP_MAX_DIMENSION || height < -LOADBMP_MAX_DIMENSION) {
+        return LOADBMP_INVALID_DIMENSIONS;
     }
 
-    if ((bmp_file_header[0] != 'B') || (bmp_file_header[1] != 'M')) {
-        fclose(f);
-        return LOADBMP_INVALID_SIGNATURE;
-    }
+    info.width = width;
+    info.height = height < 0 ? -height : height;
+    info.top_down = height < 0;
 
-    if ((bmp_info_header[14] != 24)) {
-        fclose(f);
+    if (info.bits_per_pixel != 24) {
         return LOADBMP_INVALID_BITS_PER_PIXEL;
     }
 
-    w = (bmp_info_header[4] + (bmp_info_header[5] << 8) + (bmp_info_header[6] << 16) + (bmp_info_header[7] << 24));
-    h = (bmp_info_header[8] + (bmp_info_header[9] << 8) + (bmp_info_header[10] << 16) + (bmp_info_header[11] << 24));
-    c = bmp_info_header[14] / 8;
+    // BI_BITFIELDS is only defined for 16 and 32 bpp, 24 bpp pixels are always plain BGR
+    if (compression != kCompressionRGB && compression != kCompressionBitfields) {
+        return LOADBMP_UNSUPPORTED_COMPRESSION;
+    }
 
-    padding = next_multiple_of_4(w * LOADBMP_RGB) - w * LOADBMP_RGB;
-    num_bytes = (w * LOADBMP_RGB + padding) * h;
+    return LOADBMP_NO_ERROR;
+}
 
-    std::vector<char> bmp_img(num_bytes);
-    fread(bmp_img.data(), 1, num_bytes, f);
-    fclose(f);
+LOADBMP_API unsigned int loadbmp_probe(bmp_reader &reader, const char *filename, bmp_info &info) {
+    if (!reader.open(filename)) return LOADBMP_FILE_NOT_FOUND;
 
-    return callback((bmp_buffer){w, h, c, padding, bmp_img.data()});
+    unsigned int error = loadbmp_read_info(reader, info);
+    reader.close();
+    return error;
 }
 
-LOADBMP_API unsigned int loadbmp_to_image(std::string filename, C2D_Image img) {
-    return loadbmp(filename, [img](bmp_buffer bmp) {
-        u8 *buffer = reinterpret_cast<u8 *>(img.tex->data);
-        u32 buffer_width = img.tex->width;
+// Reads and validates the headers, leaving the reader positioned at the pixel data
+LOADBMP_API unsigned int loadbmp_read_header(bmp_reader &reader, bmp_buffer &bmp) {
+    bmp_info info;
+    unsigned int error = loadbmp_read_info(reader, info);
+    if (error) {
+        return error;
+    }
 
-        float stride = std::max(static_cast<float>(bmp.height) / img.subtex->height, static_cast<float>(bmp.width) / img.subtex->width);
+    if (!reader.seek(info.pixel_offset)) {
+        return LOADBMP_FILE_OPERATION;
+    }
+
+    bmp.width = info.width;
+    bmp.height = info.height;
+    bmp.channels = info.bits_per_pixel / 8;
+    bmp.padding = next_multiple_of_4(bmp.width * LOADBMP_RGB) - bmp.width * LOADBMP_RGB;
+    bmp.top_down = info.top_down;
+
+    return LOADBMP_NO_ERROR;
+}
+
+// Scale and centering offsets that fit a bmp inside the image subtexture, keeping the aspect ratio
+struct bmp_fit {
+    float stride;
+    u32 offset_x;
+    u32 offset_y;
+
+    bmp_fit(const bmp_buffer &bmp, const Tex3DS_SubTexture *subtex) {
+        stride = std::max(static_cast<float>(bmp.height) / subtex->height, static_cast<float>(bmp.width) / subtex->width);
         u16 scaledWidth = static_cast<u16>(bmp.width / stride);
         u16 scaledHeight = static_cast<u16>(bmp.height / stride);
 
-        u32 width = img.tex->width;
-        u32 height = img.tex->height;
-
-        u32 offset_x = (img.subtex->width - scaledWidth) / 2;
-        u32 offset_y = (img.subtex->height - scaledHeight) / 2;
-
-        for (u32 y = 0; y < height; y++) {
-            for (u32 x = 0; x < width; x++) {
-                u32 dst_pos = ((((y >> 3) * (buffer_width >> 3) + (x >> 3)) << 6) +
-                               ((x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2) | ((x & 4) << 2) | ((y & 4) << 3))) *
-                              LOADBMP_RGB;
-
-                u32 src_x = (x - offset_x) * stride;
-                u32 src_y = (y - offset_y) * stride;
-                u32 src_pos = (src_x * LOADBMP_RGB) + ((bmp.height - 1) - src_y) * (bmp.width * LOADBMP_RGB + bmp.padding);
-
-                if (src_x < 0 || src_y < 0 || src_x >= bmp.width || src_y >= bmp.height) {
-                    buffer[dst_pos] = 0;
-                    buffer[dst_pos + 1] = 0;
-                    buffer[dst_pos + 2] = 0;
-                } else {
-                    buffer[dst_pos] = bmp.data[src_pos];
-                    buffer[dst_pos + 1] = bmp.data[src_pos + 1];
-                    buffer[dst_pos + 2] = bmp.data[src_pos + 2];
+        offset_x = (subtex->width - scaledWidth) / 2;
+        offset_y = (subtex->height - scaledHeight) / 2;
+    }
+};
+
+// Maps texture coordinates to source pixel coordinates along one axis.
+// LOADBMP_RESAMPLE_FLOAT scales every coordinate by the float stride, while LOADBMP_RESAMPLE_FIXED
+// walks a 16.16 fixed point accumulator so consecutive coordinates cost a single integer add.
+// Coordinates outside the image (letterbox) map to the axis size.
+struct bmp_axis_sampler {
+    unsigned int resampler;
+    float stride;
+    u32 step;
+    u32 offset;
+    u32 size;
+    u32 next;
+    u32 accumulator;
+
+    bmp_axis_sampler(unsigned int resampler, float stride, u32 offset, u32 size)
+        : resampler(resampler), stride(stride), step(static_cast<u32>(stride * 65536.0f)), offset(offset), size(size) {
+        reset();
+    }
+
+    void reset() {
+        next = 0;
+        accumulator = 0;
+    }
+
+    // Source coordinate of the next texture coordinate, coordinates must be requested in sequence from 0
+    u32 advance() {
+        u32 x = next++;
+        if (x < offset) return size;
+
+        if (resampler == LOADBMP_RESAMPLE_FLOAT) return std::min(static_cast<u32>((x - offset) * stride), size);
+
+        u32 src = accumulator >> 16;
+        accumulator += step;
+        return std::min(src, size);
+    }
+};
+
+// Reusable working memory of the streaming decoders. The buffers only ever grow, so once they fit
+// the largest image decoded by a thread, decoding does not touch the heap anymore.
+struct bmp_scratch {
+    std::vector<u8> band;      // Source rows of the tile row or block row being processed
+    std::vector<s32> columns;  // Byte offset in a source row of each texture column, -1 for letterbox
+    std::vector<s32> rows;     // Source row (in file order) of each texture row, -1 for letterbox
+    std::vector<u16> sums;     // Box filter column sums
+    std::vector<u8> texels;    // Box filter output row
+};
+
+inline bmp_scratch &loadbmp_thread_scratch() {
+    static thread_local bmp_scratch scratch;
+    return scratch;
+}
+
+inline bmp_reader &loadbmp_thread_reader() {
+    static thread_local std::unique_ptr<bmp_reader> reader = io::CreateReader();
+    return *reader;
+}
+
+// Closes the reader when the decoder returns
+struct bmp_reader_guard {
+    bmp_reader &reader;
+    ~bmp_reader_guard() { reader.close(); }
+};
+
+LOADBMP_API unsigned int loadbmp_probe(const char *filename, bmp_info &info) { return loadbmp_probe(loadbmp_thread_reader(), filename, info); }
+
+LOADBMP_API bmp_target loadbmp_target(C2D_Image img) {
+    // Subtexture coordinates are exact fractions of the power of two texture size, the top of the texture is v = 1
+    u32 x = static_cast<u32>(img.subtex->left * img.tex->width + 0.5f) & ~7u;
+    u32 y = static_cast<u32>((1.0f - img.subtex->top) * img.tex->height + 0.5f) & ~7u;
+
+    // The decoders write RGB8, the size of a tile also covers the other formats the texture may be in
+    u32 tile_size = img.tex->size / ((img.tex->width >> 3) * (img.tex->height >> 3));
+
+    bmp_target target;
+    target.width = (img.subtex->width + 7) & ~7u;
+    target.height = (img.subtex->height + 7) & ~7u;
+    target.row_size = (target.width >> 3) * tile_size;
+    target.tile_row_stride = (img.tex->width >> 3) * tile_size;
+    target.data = reinterpret_cast<u8 *>(img.tex->data) + (y >> 3) * target.tile_row_stride + (x >> 3) * tile_size;
+    return target;
+}
+
+// Zeroes the tile rows [first, last) of a target
+inline void loadbmp_zero_tile_rows(const bmp_target &target, u32 first, u32 last) {
+    for (u32 tile_row = first; tile_row < last; tile_row++) memset(target.data + tile_row * target.tile_row_stride, 0, target.row_size);
+}
+
+LOADBMP_API unsigned int loadbmp_to_image(const char *filename, C2D_Image img, unsigned int resampler) {
+    return loadbmp_to_image(loadbmp_thread_reader(), filename, img, resampler);
+}
+
+LOADBMP_API unsigned int loadbmp_to_image(const std::string &filename, C2D_Image img, unsigned int resampler) {
+    return loadbmp_to_image(loadbmp_thread_reader(), filename.c_str(), img, resampler);
+}
+
+// Copies a bmp that already has the size of the image, so no resampling is needed: the rows of each tile row
+// are read with a single read and swizzled as they are.
+inline unsigned int loadbmp_copy_native(bmp_reader &reader, const bmp_buffer &bmp, C2D_Image img) {
+    bmp_scratch &scratch = loadbmp_thread_scratch();
+
+    bmp_target target = loadbmp_target(img);
+    u32 width = target.width;
+    u32 src_row_size = bmp.width * LOADBMP_RGB + bmp.padding;
+
+    scratch.columns.resize(width);
+    for (u32 x = 0; x < width; x++) scratch.columns[x] = x < bmp.width ? x * LOADBMP_RGB : -1;
+
+    // The packed texel copies read one byte past the last pixel of a row
+    scratch.band.resize(src_row_size * 8 + sizeof(u32));
+
+    // Tile rows below the image are letterbox
+    u32 image_tile_rows = (bmp.height + 7) / 8;
+    loadbmp_zero_tile_rows(target, image_tile_rows, target.height / 8);
+
+    // Tile rows are visited in file order, the one holding the first rows of the file can be partial
+    for (u32 i = 0; i < image_tile_rows; i++) {
+        u32 tile_y = (bmp.top_down ? i : image_tile_rows - 1 - i) * 8;
+        u32 num_rows = std::min(8u, bmp.height - tile_y);
+        bool last_rows = bmp.top_down ? tile_y + num_rows == bmp.height : tile_y == 0;
+
+        // The padding of the last row may be missing from the file
+        u32 read_size = num_rows * src_row_size - (last_rows ? bmp.padding : 0);
+        if (reader.read(scratch.band.data(), read_size) != read_size) return LOADBMP_FILE_OPERATION;
+
+        const u8 *src_rows[8];
+        for (u32 row = 0; row < 8; row++) {
+            u32 slot = bmp.top_down ? row : num_rows - 1 - row;
+            src_rows[row] = row < num_rows ? scratch.band.data() + slot * src_row_size : nullptr;
+        }
+
+        u8 *tile = target.data + (tile_y >> 3) * target.tile_row_stride;
+        for (u32 tile_x = 0; tile_x < width; tile_x += 8, tile += 64 * LOADBMP_RGB) {
+            if (tile_x >= bmp.width) {
+                loadbmp_kernels::zero_tile(tile);
+            } else {
+                loadbmp_kernels::write_tile(tile, bmp_kernels::TileSource{src_rows, scratch.columns.data() + tile_x});
+            }
+        }
+    }
+
+    C3D_TexFlush(img.tex);
+
+    return LOADBMP_NO_ERROR;
+}
+
+// loadbmp_copy_native specialised at compile time for a bmp size whose rows need no padding and whose height is a whole
+// number of tile rows, as for the screens of the console. Every tile is a fixed transpose of the band, and the tiles
+// right of the image are zero.
+template <u32 Width, u32 Height, bool TopDown>
+unsigned int loadbmp_copy_screen(bmp_reader &reader, C2D_Image img) {
+    constexpr u32 kRowSize = Width * LOADBMP_RGB;
+    constexpr u32 kTiles = Width / 8;
+    static_assert(kRowSize % 4 == 0 && Width % 8 == 0 && Height % 8 == 0, "Screen rows must not need padding or partial tiles");
+
+    // Rows are read into the band in file order, so bottom-up rows are walked backwards from the top row of the tile
+    constexpr s32 kRowStride = TopDown ? kRowSize : -static_cast<s32>(kRowSize);
+    constexpr u32 kTopRowSlot = TopDown ? 0 : 7;
+
+    bmp_scratch &scratch = loadbmp_thread_scratch();
+    scratch.band.resize(kRowSize * 8 + sizeof(u32));
+    const u8 *top_row = scratch.band.data() + kTopRowSlot * kRowSize;
+
+    bmp_target target = loadbmp_target(img);
+    loadbmp_zero_tile_rows(target, Height / 8, target.height / 8);
+
+    for (u32 i = 0; i < Height / 8; i++) {
+        u32 tile_row = TopDown ? i : Height / 8 - 1 - i;
+        if (reader.read(scratch.band.data(), kRowSize * 8) != kRowSize * 8) return LOADBMP_FILE_OPERATION;
+
+        u8 *tile = target.data + tile_row * target.tile_row_stride;
+        for (u32 tile_x = 0; tile_x < kTiles; tile_x++, tile += 64 * LOADBMP_RGB) {
+            loadbmp_kernels::copy_tile<kRowStride>(tile, top_row + tile_x * 8 * LOADBMP_RGB);
+        }
+        memset(tile, 0, target.row_size - kTiles * 64 * LOADBMP_RGB);
+    }
+
+    C3D_TexFlush(img.tex);
+
+    return LOADBMP_NO_ERROR;
+}
+
+// Picks the compile time path for the screen sizes of Luma screenshots
+inline unsigned int loadbmp_copy_native_size(bmp_reader &reader, const bmp_buffer &bmp, C2D_Image img) {
+    if (bmp.width == 400 && bmp.height == 240) {
+        return bmp.top_down ? loadbmp_copy_screen<400, 240, true>(reader, img) : loadbmp_copy_screen<400, 240, false>(reader, img);
+    }
+    if (bmp.width == 320 && bmp.height == 240) {
+        return bmp.top_down ? loadbmp_copy_screen<320, 240, true>(reader, img) : loadbmp_copy_screen<320, 240, false>(reader, img);
+    }
+    return loadbmp_copy_native(reader, bmp, img);
+}
+
+LOADBMP_API unsigned int loadbmp_to_image(bmp_reader &reader, const char *filename, C2D_Image img, unsigned int resampler) {
+    bmp_info info;
+    return loadbmp_to_image(reader, filename, img, info, resampler);
+}
+
+LOADBMP_API unsigned int loadbmp_to_image(bmp_reader &reader, const char *filename, C2D_Image img, bmp_info &info, unsigned int resampler) {
+    if (img.tex->fmt != GPU_RGB8) return LOADBMP_UNSUPPORTED_TEXTURE_FORMAT;
+    if (!reader.open(filename)) return LOADBMP_FILE_NOT_FOUND;
+    bmp_reader_guard guard{reader};
+
+    bmp_buffer bmp;
+    unsigned int error = loadbmp_read_header(reader, bmp);
+    if (error) {
+        return error;
+    }
+    info = bmp_info{bmp.width, bmp.height, static_cast<u16>(bmp.channels * 8), static_cast<u32>(reader.tell()), bmp.top_down};
+
+    if (bmp.width == img.subtex->width && bmp.height == img.subtex->height) {
+        return loadbmp_copy_native_size(reader, bmp, img);
+    }
+    size_t data_start = reader.tell();
+
+    bmp_scratch &scratch = loadbmp_thread_scratch();
+    bmp_fit fit(bmp, img.subtex);
+
+    bmp_target target = loadbmp_target(img);
+    u32 width = target.width;
+    u32 height = target.height;
+
+    u32 src_row_size = bmp.width * LOADBMP_RGB + bmp.padding;
+
+    bmp_axis_sampler sampler_x(resampler, fit.stride, fit.offset_x, bmp.width);
+    scratch.columns.resize(width);
+    for (u32 x = 0; x < width; x++) {
+        u32 src_x = sampler_x.advance();
+        scratch.columns[x] = src_x < bmp.width ? src_x * LOADBMP_RGB : -1;
+    }
+
+    bmp_axis_sampler sampler_y(resampler, fit.stride, fit.offset_y, bmp.height);
+    scratch.rows.resize(height);
+    for (u32 y = 0; y < height; y++) {
+        u32 src_y = sampler_y.advance();
+        if (src_y >= bmp.height) {
+            scratch.rows[y] = -1;
+        } else {
+            scratch.rows[y] = bmp.top_down ? src_y : (bmp.height - 1) - src_y;
+        }
+    }
+
+    // The packed texel copies read one byte past the last pixel of a row
+    scratch.band.resize(src_row_size * 8 + sizeof(u32));
+    constexpr s32 kMaxSkippedRows = 8;
+
+    // The texture is filled in file order: from its bottom tile row to the top one for the usual bottom-up bmps,
+    // top to bottom for top-down ones. Only the source rows sampled by a tile row are read into the band,
+    // then the tile row is swizzled one 8x8 tile at a time.
+    s32 file_row = 0;
+    s32 last_src_row = -1;
+    const u8 *last_slot = nullptr;
+    for (u32 tile_row = 0; tile_row < height / 8 && !error; tile_row++) {
+        u32 tile_y = bmp.top_down ? tile_row * 8 : height - (tile_row + 1) * 8;
+
+        const u8 *src_rows[8] = {};
+        for (u32 i = 0; i < 8; i++) {
+            u32 row = bmp.top_down ? i : 7 - i;
+            s32 src_row = scratch.rows[tile_y + row];
+            if (src_row < 0) {
+                src_rows[row] = nullptr;
+                continue;
+            }
+
+            u8 *slot = scratch.band.data() + row * src_row_size;
+            if (src_row == last_src_row) {
+                // Upscaling repeats rows, copy it instead of reading it again (the previous slot can belong to the previous tile row)
+                if (slot != last_slot) memcpy(slot, last_slot, src_row_size);
+                src_rows[row] = slot;
+                last_slot = slot;
+                continue;
+            }
+
+            if (src_row < file_row || src_row - file_row > kMaxSkippedRows) {
+                if (!reader.seek(data_start + src_row * src_row_size)) error = LOADBMP_FILE_OPERATION;
+            } else {
+                // Short gaps (downscaling) are read through, sequential reads are cheaper than seeks on the SD card
+                for (; file_row < src_row && !error; file_row++) {
+                    if (reader.read(slot, src_row_size) != src_row_size) error = LOADBMP_FILE_OPERATION;
                 }
             }
+
+            // The padding of the last row may be missing from the file
+            u32 read_size = src_row == static_cast<s32>(bmp.height - 1) ? bmp.width * LOADBMP_RGB : src_row_size;
+            if (error || reader.read(slot, read_size) != read_size) {
+                error = LOADBMP_FILE_OPERATION;
+                break;
+            }
+
+            src_rows[row] = slot;
+            last_src_row = src_row;
+            last_slot = slot;
+            file_row = src_row + 1;
+        }
+        // The rows after a failed read were never filled
+        if (error) break;
+
+        bool letterbox_row = std::all_of(src_rows, src_rows + 8, [](const u8 *row) { return row == nullptr; });
+
+        u8 *tile = target.data + (tile_y >> 3) * target.tile_row_stride;
+        for (u32 tile_x = 0; tile_x < width; tile_x += 8) {
+            const s32 *src_cols = scratch.columns.data() + tile_x;
+
+            if (letterbox_row || std::all_of(src_cols, src_cols + 8, [](s32 col) { return col < 0; })) {
+                loadbmp_kernels::zero_tile(tile);
+            } else {
+                loadbmp_kernels::write_tile(tile, bmp_kernels::TileSource{src_rows, src_cols});
+            }
+
+            tile += 64 * LOADBMP_RGB;
         }
+    }
+
+    C3D_TexFlush(img.tex);
+
+    return error;
+}
+
+// Writes a row of RGB texels to row y of a target
+inline void loadbmp_write_texture_row(const bmp_target &target, u32 y, u32 x, const u8 *texels, u32 count) {
+    u8 *tile_row = target.data + (y >> 3) * target.tile_row_stride;
+    const u8 *offsets = kTileOffsets.data() + (y & 7) * 8;
+
+    for (u32 end = x + count; x < end; x++, texels += LOADBMP_RGB) {
+        u8 *dst = tile_row + ((x >> 3) * 64 + offsets[x & 7]) * LOADBMP_RGB;
+        dst[0] = texels[0];
+        dst[1] = texels[1];
+        dst[2] = texels[2];
+    }
+}
+
+LOADBMP_API unsigned int loadbmp_to_thumbnail(const char *filename, C2D_Image img) { return loadbmp_to_thumbnail(loadbmp_thread_reader(), filename, img); }
+
+LOADBMP_API unsigned int loadbmp_to_thumbnail(const std::string &filename, C2D_Image img) {
+    return loadbmp_to_thumbnail(loadbmp_thread_reader(), filename.c_str(), img);
+}
+
+LOADBMP_API unsigned int loadbmp_to_thumbnail(bmp_reader &reader, const char *filename, C2D_Image img) {
+    constexpr u32 block = LOADBMP_THUMBNAIL_DOWNSCALE;
+
+    if (img.tex->fmt != GPU_RGB8) return LOADBMP_UNSUPPORTED_TEXTURE_FORMAT;
+    if (!reader.open(filename)) return LOADBMP_FILE_NOT_FOUND;
+    bmp_reader_guard guard{reader};
+
+    bmp_buffer bmp;
+    unsigned int error = loadbmp_read_header(reader, bmp);
+    if (error) {
+        return error;
+    }
+
+    bmp_fit fit(bmp, img.subtex);
+    if (fit.stride != block) {
+        // The box filter only handles an exact downscale, leave other sizes to the generic resampler
+        reader.close();
+        return loadbmp_to_image(reader, filename, img);
+    }
+
+    u32 src_row_size = bmp.width * LOADBMP_RGB + bmp.padding;
+    u32 dst_width = std::min((bmp.width + block - 1) / block, img.subtex->width - fit.offset_x);
+
+    u32 used_width = std::min(bmp.width, dst_width * block);
+
+    // One block row of source rows, the per byte sums of its columns and the averaged output row
+    bmp_scratch &scratch = loadbmp_thread_scratch();
+    scratch.band.resize(src_row_size * block);
+    scratch.sums.resize(used_width * LOADBMP_RGB);
+    scratch.texels.resize(dst_width * LOADBMP_RGB);
+
+    u8 *rows = scratch.band.data();
+    u16 *sums = scratch.sums.data();
+    u8 *texels = scratch.texels.data();
+
+    bmp_target target = loadbmp_target(img);
+    loadbmp_zero_tile_rows(target, 0, target.height / 8);
+
+    // Block rows are read in file order, bottom to top for the usual bottom-up bmps and top to bottom for top-down ones.
+    // When the height is not a multiple of the block size, the block row at the top of the image is partial.
+    for (u32 file_row = 0; file_row < bmp.height;) {
+        u32 y = bmp.top_down ? file_row : (bmp.height - 1) - file_row;
+        u32 block_top = y / block * block;
+        u32 num_rows = bmp.top_down ? std::min(block, bmp.height - block_top) : y - block_top + 1;
+        file_row += num_rows;
+
+        // The padding of the last row may be missing from the file
+        u32 read_size = src_row_size * num_rows - (file_row == bmp.height ? bmp.padding : 0);
+        if (reader.read(rows, read_size) != read_size) {
+            error = LOADBMP_FILE_OPERATION;
+            break;
+        }
+
+        loadbmp_kernels::sum_rows(rows, src_row_size, num_rows, used_width * LOADBMP_RGB, sums);
+        loadbmp_kernels::average_blocks<block>(sums, used_width, num_rows, texels, dst_width);
+
+        loadbmp_write_texture_row(target, fit.offset_y + block_top / block, fit.offset_x, texels, dst_width);
+    }
+
+    C3D_TexFlush(img.tex);
+
+    return error;
+}
+
+LOADBMP_API unsigned int loadbmp_image_to_thumbnail(C2D_Image src, C2D_Image img, bool smooth) {
+    constexpr u32 block = LOADBMP_THUMBNAIL_DOWNSCALE;
+    // A block is then a quarter of a tile, which the Morton order keeps as 16 texels in a row
+    static_assert(block == 4, "Blocks must be the quarters of a tile");
+    constexpr u32 kBlockTexels = block * block;
+
+    if (src.tex->fmt != GPU_RGB8 || img.tex->fmt != GPU_RGB8) return LOADBMP_UNSUPPORTED_TEXTURE_FORMAT;
+    if (src.subtex->width != img.subtex->width * block || src.subtex->height != img.subtex->height * block) return LOADBMP_INVALID_DIMENSIONS;
+
+    bmp_target source = loadbmp_target(src);
+    bmp_target target = loadbmp_target(img);
+
+    // Each tile of img takes its texels from block x block tiles of src, 2x2 from each. The tiles of img right of and
+    // below the subtexture of src are zeroed, like the decoders do.
+    for (u32 tile_row = 0; tile_row < target.height / 8; tile_row++) {
+        u8 *tile = target.data + tile_row * target.tile_row_stride;
+        for (u32 tile_x = 0; tile_x < target.width / 8; tile_x++, tile += 64 * LOADBMP_RGB) {
+            for (u32 j = 0; j < block; j++) {
+                for (u32 i = 0; i < block; i++) {
+                    u32 src_tile_row = tile_row * block + j;
+                    u32 src_tile_x = tile_x * block + i;
+                    const u8 *src_tile = nullptr;
+                    if (src_tile_row < source.height / 8 && src_tile_x < source.width / 8) {
+                        src_tile = source.data + src_tile_row * source.tile_row_stride + src_tile_x * 64 * LOADBMP_RGB;
+                    }
+
+                    for (u32 quarter = 0; quarter < 4; quarter++) {
+                        u32 x = i * 2 + (quarter & 1);
+                        u32 y = j * 2 + (quarter >> 1);
+                        u8 *dst = tile + kTileOffsets[y * 8 + x] * LOADBMP_RGB;
+                        if (src_tile == nullptr) {
+                            memset(dst, 0, LOADBMP_RGB);
+                            continue;
+                        }
+
+                        const u8 *texels = src_tile + quarter * kBlockTexels * LOADBMP_RGB;
+                        if (!smooth) {
+                            memcpy(dst, texels, LOADBMP_RGB);
+                        } else {
+                            u32 sums[LOADBMP_RGB] = {0, 0, 0};
+                            for (u32 t = 0; t < kBlockTexels * LOADBMP_RGB; t += LOADBMP_RGB) {
+                                sums[0] += texels[t];
+                                sums[1] += texels[t + 1];
+                                sums[2] += texels[t + 2];
+                            }
+                            for (u32 c = 0; c < LOADBMP_RGB; c++) dst[c] = (sums[c] + kBlockTexels / 2) / kBlockTexels;
+                        }
+                    }
+                }
+            }
+        }
+    }
 
-        C3D_TexFlush(img.tex);
+    C3D_TexFlush(img.tex);
 
-        return LOADBMP_NO_ERROR;
-    });
+    return LOADBMP_NO_ERROR;
 }
 
 #endif
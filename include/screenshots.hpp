@@ -4,6 +4,7 @@
 #include <3ds.h>
 #include <citro2d.h>
 
+#include <atomic>
 #include <memory>
 #include <set>
 #include <string>
@@ -21,6 +22,14 @@ struct Screenshot {
     ~Screenshot();
 };
 
+// thumbnail_slot of screenshots without a thumbnail cache slot
+constexpr u32 kNoThumbnailSlot = UINT32_MAX;
+
+// Thumbnail published to the UI: the cache slot in the low half and the generation of the slot when the thumbnail was
+// loaded in the high half. Evicting a thumbnail bumps the generation of its slot, so older handles no longer resolve.
+using thumbnail_handle = u64;
+constexpr thumbnail_handle kNoThumbnail = 0;
+
 struct ScreenshotInfo {
     std::string name;
 
@@ -30,8 +39,8 @@ struct ScreenshotInfo {
 
     const std::vector<tags::tag_ptr>& tags;
 
-    bool has_thumbnail;
-    const C2D_Image* thumbnail;
+    std::atomic<thumbnail_handle> thumbnail = kNoThumbnail;  // Released once the thumbnail is loaded, see GetThumbnail
+    u32 thumbnail_slot = kNoThumbnailSlot;                     // Owned by the thumbnail thread
 
     ScreenshotInfo(std::string name, const std::vector<tags::tag_ptr>& tags);
 
@@ -53,6 +62,41 @@ using screenshot_ptr = const Screenshot*;
 using info_ptr = const ScreenshotInfo*;
 using mutable_info_ptr = ScreenshotInfo*;
 
+enum ThumbnailCacheEvent {
+    kCacheCapacity = 0,  // The capacity was chosen at startup or lowered under memory pressure
+    kCacheEviction = 1,  // A thumbnail was dropped to make room
+    kCacheDerived = 2,   // A thumbnail was taken from the top image of a loaded screenshot instead of its bmp
+};
+
+struct ThumbnailCacheStats {
+    size_t budget;      // Linear memory the cache may take, in bytes
+    size_t capacity;    // Thumbnails the cache may hold
+    size_t thumbnails;  // Thumbnails it holds
+    size_t pages;       // Atlas pages allocated
+    size_t evictions;   // Thumbnails dropped so far
+};
+
+// Instrumentation of the thumbnail cache, called from the thumbnail thread except for the first kCacheCapacity event
+using thumbnail_cache_hook = void (*)(ThumbnailCacheEvent event, const ThumbnailCacheStats& stats);
+
+// Speed of the thumbnail grid, estimated from the page shown every frame
+class ScrollTracker {
+   public:
+    // Page shown at a system tick, returns the speed in pages per second, negative going back
+    float Update(size_t page, u64 tick);
+
+   private:
+    // Speed over the last page changes, so a page flipped every few frames reads as a steady speed
+    static constexpr size_t kSamples = 4;
+
+    struct PageChange {
+        size_t page;
+        u64 tick;
+    };
+    PageChange changes[kSamples];
+    size_t num_changes = 0;
+};
+
 void Init();
 void Exit();
 
@@ -62,6 +106,18 @@ info_ptr GetInfo(std::size_t index);
 
 size_t Count();
 size_t NumLoadedThumbnails();
+// Screenshots given to a "Load" callback that were not preloaded
+size_t NumMissedScreenshots();
+// Thumbnail to draw for a screenshot, nullptr while it is not loaded. Never blocks: the image is left untouched until
+// two calls to EndFrame later, when the GPU is done drawing it.
+const C2D_Image* GetThumbnail(info_ptr info);
+// Whether the thumbnail of a screenshot is loaded, without drawing it
+bool HasThumbnail(info_ptr info);
+// Called once every frame, after the frame is submitted
+void EndFrame();
+void SetThumbnailCacheHook(thumbnail_cache_hook hook);
+// Page of thumbnails shown and how fast it changes, so the thumbnails ahead are loaded first and the ones behind evicted
+void SetScroll(size_t page, float pages_per_second);
 bool FoundScreenshots();
 
 const ScreenshotOrder GetOrder();
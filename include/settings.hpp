@@ -3,13 +3,24 @@
 
 #include <string>
 
+#include "thumbnail_format.hpp"
+
 namespace settings {
 void Save();
 void Load();
 
 const std::string ScreenshotsPath();
+void SetScreenshotsPath(std::string path);
 const std::string TagsPath();
+// Prefix of the thumbnail cache files
+const std::string ThumbnailCachePath();
+void SetThumbnailCachePath(std::string path);
 const bool ShowConsole();
+const bool SmoothThumbnails();
+const screenshots::ThumbnailFormat GetThumbnailFormat();
+// Full screenshots kept loaded: the one shown and its neighbours
+const int ScreenshotBuffers();
+void SetScreenshotBuffers(int buffers);
 
 const int GetExtraStereoOffset();
 void SetExtraStereoOffset(int offset);
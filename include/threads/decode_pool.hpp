@@ -0,0 +1,171 @@
+#ifndef THREADS_DECODE_POOL_HPP_
+#define THREADS_DECODE_POOL_HPP_
+
+#include <3ds.h>
+
+#include <atomic>
+#include <deque>
+#include <iterator>
+#include <memory>
+
+#include "io.hpp"
+#include "loadbmp.hpp"
+#include "read_ahead_thread.hpp"
+
+namespace screenshots::threads {
+
+// Decoding work run by a DecodePool worker. The pool does not touch a job once Run returns, so Run may hand it back
+// to its owner at the end.
+class DecodeJob {
+   public:
+    virtual ~DecodeJob() = default;
+
+    // worker is the index of the worker running the job, below DecodePool::NumWorkers(), and reader its own reader
+    virtual void Run(size_t worker, bmp_reader &reader) = 0;
+};
+
+enum DecodePriority {
+    kFullImageJob = 0,  // Taken before any thumbnail job, from every worker
+    kThumbnailJob = 1,
+
+    kNumDecodePriorities,
+};
+
+// Workers decoding on every core the application may use: the core of the app and, when the system lets threads be
+// created there, the system core (with an app CPU time limit set) and the extra cores of the New 3DS.
+//
+// Jobs are queued round robin on per-worker deques, one for each priority. A worker takes the oldest job of its own
+// deques and, when they are empty, steals the newest job of another worker's, full-image jobs of every worker coming
+// before any thumbnail job.
+class DecodePool {
+   private:
+    // Tried in order, -2 is the default core of the process
+    static constexpr int kCores[] = {-2, 1, 2, 3};
+    static constexpr size_t kMaxWorkers = std::size(kCores);
+
+    struct Worker {
+        DecodePool &pool;
+        size_t index;
+
+        LightLock lock;
+        std::deque<DecodeJob *> queues[kNumDecodePriorities];
+
+        std::unique_ptr<bmp_reader> file_reader = io::CreateReader();
+        ReadAheadThread read_ahead{*file_reader};
+
+        Thread thread = nullptr;
+        Handle workReady;
+
+        Worker(DecodePool &pool, size_t index) : pool(pool), index(index) {
+            LightLock_Init(&lock);
+            svcCreateEvent(&workReady, RESET_ONESHOT);
+        }
+
+        ~Worker() { svcCloseHandle(workReady); }
+    };
+
+    std::unique_ptr<Worker> workers[kMaxWorkers];
+    std::atomic<size_t> num_workers = 0;
+    std::atomic<size_t> next_worker = 0;
+
+    std::atomic<bool> run_threads = false;
+
+    DecodeJob *Pop(Worker &worker, DecodePriority priority, bool oldest) {
+        DecodeJob *job = nullptr;
+
+        LightLock_Lock(&worker.lock);
+        auto &queue = worker.queues[priority];
+        if (!queue.empty()) {
+            job = oldest ? queue.front() : queue.back();
+            oldest ? queue.pop_front() : queue.pop_back();
+        }
+        LightLock_Unlock(&worker.lock);
+
+        return job;
+    }
+
+    DecodeJob *Take(Worker &worker) {
+        size_t count = num_workers;
+        for (int priority = 0; priority < kNumDecodePriorities; priority++) {
+            if (DecodeJob *job = Pop(worker, static_cast<DecodePriority>(priority), true)) return job;
+
+            for (size_t i = 1; i < count; i++) {
+                Worker &victim = *workers[(worker.index + i) % count];
+                if (DecodeJob *job = Pop(victim, static_cast<DecodePriority>(priority), false)) return job;
+            }
+        }
+        return nullptr;
+    }
+
+    void WorkerMain(Worker &worker) {
+        while (run_threads) {
+            if (DecodeJob *job = Take(worker)) {
+                job->Run(worker.index, worker.read_ahead);
+                continue;
+            }
+
+            svcWaitSynchronization(worker.workReady, U64_MAX);
+        }
+    }
+
+    static void ThreadEntrypointFn(void *arg) {
+        Worker &worker = *static_cast<Worker *>(arg);
+        worker.pool.WorkerMain(worker);
+    }
+
+   public:
+    // Starts a worker on each usable core, up to max_workers
+    explicit DecodePool(size_t max_workers = kMaxWorkers) {
+        s32 prio = 0;
+        svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+        run_threads = true;
+
+        // Workers read the files and run the decoders' frames on top, more than the 4 KB of the other threads
+        size_t stackSize = (16 * 1024);
+        for (int core : kCores) {
+            size_t index = num_workers;
+            if (index == max_workers) break;
+
+            workers[index] = std::make_unique<Worker>(*this, index);
+            workers[index]->thread = threadCreate(ThreadEntrypointFn, workers[index].get(), stackSize, prio - 1, core, false);
+            if (workers[index]->thread == nullptr) {
+                workers[index].reset();
+                continue;
+            }
+
+            num_workers = index + 1;
+        }
+    }
+
+    // Jobs still queued are not run
+    ~DecodePool() {
+        run_threads = false;
+
+        for (size_t i = 0; i < num_workers; i++) svcSignalEvent(workers[i]->workReady);
+        for (size_t i = 0; i < num_workers; i++) {
+            threadJoin(workers[i]->thread, U64_MAX);
+            threadFree(workers[i]->thread);
+        }
+    }
+
+    DecodePool(const DecodePool &) = delete;
+    DecodePool &operator=(const DecodePool &) = delete;
+
+    size_t NumWorkers() { return num_workers; }
+
+    // The job must stay alive until it has run
+    void Submit(DecodeJob &job, DecodePriority priority) {
+        size_t count = num_workers;
+        Worker &worker = *workers[next_worker++ % count];
+
+        LightLock_Lock(&worker.lock);
+        worker.queues[priority].push_back(&job);
+        LightLock_Unlock(&worker.lock);
+
+        // Idle workers steal it if its own worker is busy
+        for (size_t i = 0; i < count; i++) svcSignalEvent(workers[i]->workReady);
+    }
+};
+}  // namespace screenshots::threads
+
+#endif  // THREADS_DECODE_POOL_HPP_
@@ -0,0 +1,220 @@
+#ifndef THREADS_READ_AHEAD_THREAD_HPP_
+#define THREADS_READ_AHEAD_THREAD_HPP_
+
+#include <3ds.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include "loadbmp.hpp"
+
+namespace screenshots::threads {
+
+// Double buffered reader that fetches the next chunk of the open file from the source reader on its own thread,
+// so the SD card reads overlap with the decoding of the chunk already read
+class ReadAheadThread : public bmp_reader {
+   private:
+    static constexpr size_t kChunkSize = 16 * 1024;
+
+    enum ChunkState {
+        kIdle,
+        kRequested,  // Waiting to be filled by the read ahead thread, which owns the chunk in this state
+        kReady,
+    };
+
+    struct Chunk {
+        std::vector<u8> data = std::vector<u8>(kChunkSize);
+        std::atomic<int> state = kIdle;
+        size_t offset = 0;
+        size_t size = 0;
+    };
+
+    bmp_reader &source;
+
+    Chunk chunks[2];
+    static constexpr int num_chunks = (sizeof(chunks) / sizeof(chunks[0]));
+
+    bool file_open = false;
+    int current_chunk = 0;
+    size_t position = 0;
+    size_t next_chunk_offset = 0;
+
+    std::atomic<bool> run_thread = false;
+
+    Thread readAheadThread;
+    Handle fillRequest;
+    Handle chunkReady;
+
+    void FillChunk(Chunk &chunk) {
+        if (!source.seek(chunk.offset)) {
+            chunk.size = 0;
+        } else {
+            chunk.size = source.read(chunk.data.data(), kChunkSize);
+        }
+
+        chunk.state = kReady;
+        svcSignalEvent(chunkReady);
+    }
+
+    void ThreadMain() {
+        while (run_thread) {
+            // Fill the requested chunk that will be consumed first
+            Chunk *next = nullptr;
+            for (auto &chunk : chunks) {
+                if (chunk.state == kRequested && (next == nullptr || chunk.offset < next->offset)) next = &chunk;
+            }
+
+            if (next != nullptr) {
+                FillChunk(*next);
+                continue;
+            }
+
+            svcWaitSynchronization(fillRequest, U64_MAX);
+            svcClearEvent(fillRequest);
+        }
+    }
+
+    static void ThreadEntrypointFn(void *arg) {
+        ReadAheadThread &thread = *static_cast<ReadAheadThread *>(arg);
+        thread.ThreadMain();
+    }
+
+    void RequestChunk(Chunk &chunk, size_t offset) {
+        chunk.offset = offset;
+        chunk.size = 0;
+        chunk.state = kRequested;
+        svcSignalEvent(fillRequest);
+    }
+
+    void WaitChunk(Chunk &chunk) {
+        while (chunk.state == kRequested) {
+            svcWaitSynchronization(chunkReady, U64_MAX);
+        }
+    }
+
+    // Waits for the reads in flight, after which the source and every chunk are owned by the caller
+    void WaitIdle() {
+        for (auto &chunk : chunks) WaitChunk(chunk);
+    }
+
+    // Restarts the pipeline at the given offset
+    void Refill(size_t offset) {
+        WaitIdle();
+
+        current_chunk = 0;
+        position = offset;
+        next_chunk_offset = offset + kChunkSize * num_chunks;
+        for (int i = 0; i < num_chunks; i++) RequestChunk(chunks[i], offset + kChunkSize * i);
+    }
+
+   public:
+    explicit ReadAheadThread(bmp_reader &source) : source(source) {
+        s32 prio = 0;
+        svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+        svcCreateEvent(&fillRequest, RESET_ONESHOT);
+        svcCreateEvent(&chunkReady, RESET_ONESHOT);
+        run_thread = true;
+
+        size_t stackSize = (4 * 1024);
+        readAheadThread = threadCreate(ThreadEntrypointFn, this, stackSize, prio - 1, -2, false);
+    }
+
+    ~ReadAheadThread() {
+        close();
+
+        run_thread = false;
+        svcSignalEvent(fillRequest);
+
+        threadJoin(readAheadThread, U64_MAX);
+        threadFree(readAheadThread);
+
+        svcCloseHandle(fillRequest);
+        svcCloseHandle(chunkReady);
+    }
+
+    bool open(const char *filename) override {
+        close();
+
+        if (!source.open(filename)) return false;
+
+        file_open = true;
+        Refill(0);
+        return true;
+    }
+
+    void close() override {
+        if (!file_open) return;
+
+        WaitIdle();
+        for (auto &chunk : chunks) chunk.state = kIdle;
+
+        source.close();
+        file_open = false;
+    }
+
+    size_t read(void *dst, size_t size) override {
+        u8 *out = static_cast<u8 *>(dst);
+        size_t total = 0;
+
+        while (total < size) {
+            Chunk &chunk = chunks[current_chunk];
+            WaitChunk(chunk);
+
+            size_t chunk_position = position - chunk.offset;
+            if (chunk_position >= chunk.size) break;  // End of file
+
+            size_t count = std::min(size - total, chunk.size - chunk_position);
+            memcpy(out + total, chunk.data.data() + chunk_position, count);
+            total += count;
+            position += count;
+
+            if (position == chunk.offset + kChunkSize) {
+                // Hand the consumed chunk back to be filled while the other one is used
+                RequestChunk(chunk, next_chunk_offset);
+                next_chunk_offset += kChunkSize;
+                current_chunk = (current_chunk + 1) % num_chunks;
+            }
+        }
+
+        return total;
+    }
+
+    bool seek(size_t offset) override {
+        if (!file_open) return false;
+
+        // Seeks inside the current chunk or into the chunk being read ahead do not restart the pipeline. Past the end
+        // of the file they fail: the chunk holding the end is shorter than the offset.
+        Chunk &chunk = chunks[current_chunk];
+        Chunk &next = chunks[(current_chunk + 1) % num_chunks];
+        if (offset >= chunk.offset && offset < chunk.offset + kChunkSize) {
+            WaitChunk(chunk);
+            if (offset > chunk.offset + chunk.size) return false;
+
+            position = offset;
+        } else if (offset >= next.offset && offset < next.offset + kChunkSize && next.offset == chunk.offset + kChunkSize) {
+            WaitChunk(next);
+            if (offset > next.offset + next.size) return false;
+
+            // The current chunk is still being filled when a read just reached it
+            WaitChunk(chunk);
+            RequestChunk(chunk, next_chunk_offset);
+            next_chunk_offset += kChunkSize;
+            current_chunk = (current_chunk + 1) % num_chunks;
+            position = offset;
+        } else {
+            // Far seeks fail where the source fails
+            WaitIdle();
+            if (!source.seek(offset)) return false;
+
+            Refill(offset);
+        }
+        return true;
+    }
+
+    size_t tell() override { return position; }
+};
+}  // namespace screenshots::threads
+
+#endif  // THREADS_READ_AHEAD_THREAD_HPP_
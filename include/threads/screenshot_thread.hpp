@@ -3,10 +3,16 @@
 
 #include <3ds.h>
 
+#include <algorithm>
 #include <atomic>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
 #include <vector>
 
+#include "decode_pool.hpp"
 #include "loadbmp.hpp"
 #include "screenshots.hpp"
 #include "ui.hpp"
@@ -15,71 +21,170 @@ namespace screenshots::threads {
 
 class ScreenshotThread {
    private:
+    // A loaded screenshot, kept for the screenshot it holds
+    struct Buffer {
+        Screenshot *screenshot;
+        info_ptr info = nullptr;  // nullptr while it holds none
+        bool native_top = false;  // Whether the top image was decoded without error at the size of its bmp
+    };
+
+    // A screenshot to give to the callback, and the ones to preload after it, closest first
+    struct Request {
+        info_ptr info = nullptr;
+        void (*callback)(screenshot_ptr) = nullptr;
+        std::vector<info_ptr> neighbours;
+    };
+
     std::atomic<bool> run_thread = false;
-    std::atomic<bool> loading_screenshot = false;
 
-    info_ptr loading_screenshot_info = nullptr;
-    void (*loading_screenshot_callback)(screenshot_ptr) = nullptr;
+    // Set by "Load", taken by the thread
+    std::atomic<Request *> next_request = nullptr;
+    Request request;
+    bool handed = true;  // Whether request.info was given to its callback
+
+    // Ring of loaded screenshots: the one shown and its neighbours. A screenshot goes into the buffer of the least wanted
+    // one (see Rank), never into the buffer given to the last callback, which is being shown.
+    std::vector<Buffer> buffers;
+    Buffer *shown_buffer = nullptr;
+    std::atomic<int> missed_screenshots = 0;  // Requested while not in the ring, loaded before their callback
+
+    // One image of the screenshot, decoded on a pool worker so the images of a screenshot load on every core. Each
+    // worker reads through its own reader and scratch buffers, kept from one image to the next.
+    struct ImageJob : public DecodeJob {
+        ScreenshotThread *thread = nullptr;
+        const char *filename = nullptr;
+        C2D_Image img = {nullptr, nullptr};
+        unsigned int error = LOADBMP_NO_ERROR;
+        bmp_info info = {};
+
+        void Set(const std::string &path, C2D_Image image) {
+            filename = path.c_str();
+            img = image;
+            error = LOADBMP_NO_ERROR;
+        }
 
-    std::atomic<info_ptr> next_screenshot_info = nullptr;
-    void (*next_screenshot_callback)(screenshot_ptr) = nullptr;
+        void Run(size_t worker, bmp_reader &reader) override {
+            error = loadbmp_to_image(reader, filename, img, info);
 
-    // Use a screenshot for loading and another for returning to the callback
-    Screenshot *screenshot_buffer[2];
-    static constexpr int num_buffers = (sizeof(screenshot_buffer) / sizeof(screenshot_buffer[0]));
+            // The last image signals, once, so the screenshot thread waits exactly once
+            if (--thread->decoding_images == 0) svcSignalEvent(thread->imagesDecoded);
+        }
+    };
 
-    int current_buffer = 0;
-    int last_buffer = 0;
+    DecodePool &pool;
+    // Given the top image of every screenshot shown at the size of its bmp, so the thumbnail can be taken from it
+    void (*top_image_hook)(info_ptr, C2D_Image);
+    ImageJob image_jobs[3];
+    std::atomic<int> decoding_images = 0;
 
     Thread loadScreenshotThread;
     Handle loadScreenshotRequest;
+    Handle imagesDecoded;
 
-    void LoadScreenshot(info_ptr screenshot_info) {
-        Screenshot *screenshot = screenshot_buffer[current_buffer];
+    enum { kTopRight, kTop, kBottom };
 
-        unsigned int error;
-        if (screenshot_info->path_top_right.size() > 0) {
-            error = loadbmp_to_image(screenshot_info->path_top_right, screenshot->top_right);
-            if (error) {
-                screenshot->is_3d = false;
-            } else {
-                screenshot->is_3d = true;
-            }
-        } else {
-            screenshot->is_3d = false;
-        }
+    void LoadScreenshot(info_ptr screenshot_info, Screenshot *screenshot) {
+        image_jobs[kTopRight].Set(screenshot_info->path_top_right, screenshot->top_right);
+        image_jobs[kTop].Set(screenshot_info->path_top, screenshot->top);
+        image_jobs[kBottom].Set(screenshot_info->path_bottom, screenshot->bottom);
+
+        // 2D screenshots have no right eye image
+        bool has_top_right = screenshot_info->path_top_right.size() > 0;
+        int first_job = has_top_right ? kTopRight : kTop;
+        decoding_images = std::size(image_jobs) - first_job;
+        for (int i = first_job; i < static_cast<int>(std::size(image_jobs)); i++) pool.Submit(image_jobs[i], kFullImageJob);
+
+        svcWaitSynchronization(imagesDecoded, U64_MAX);
 
-        error = loadbmp_to_image(screenshot_info->path_top, screenshot->top);
-        if (error) {
+        screenshot->is_3d = has_top_right && !image_jobs[kTopRight].error;
+
+        if (image_jobs[kTop].error) {
             memset(screenshot->top_right.tex->data, 0, screenshot->top_right.tex->size);
             memset(screenshot->top.tex->data, 0, screenshot->top.tex->size);
             screenshot->is_3d = false;
         }
 
-        error = loadbmp_to_image(screenshot_info->path_bottom, screenshot->bottom);
-        if (error) {
+        if (image_jobs[kBottom].error) {
             memset(screenshot->bottom.tex->data, 0, screenshot->bottom.tex->size);
         }
     }
 
+    Buffer *Find(info_ptr info) {
+        for (auto &buffer : buffers) {
+            if (buffer.info == info) return &buffer;
+        }
+        return nullptr;
+    }
+
+    // Place of a screenshot in the request: 0 for the requested one, then its neighbours. SIZE_MAX when not wanted.
+    size_t Rank(info_ptr info) {
+        if (info == nullptr) return SIZE_MAX;
+        if (info == request.info) return 0;
+
+        auto neighbour = std::find(request.neighbours.begin(), request.neighbours.end(), info);
+        return neighbour != request.neighbours.end() ? neighbour - request.neighbours.begin() + 1 : SIZE_MAX;
+    }
+
+    // Loads a screenshot of the request into the buffer of the least wanted one. The request holds fewer neighbours
+    // than there are buffers, so that one is always less wanted than the screenshot loaded.
+    Buffer &LoadBuffer(info_ptr info) {
+        Buffer *target = nullptr;
+        size_t target_rank = 0;
+        for (auto &buffer : buffers) {
+            if (&buffer == shown_buffer) continue;
+
+            size_t rank = Rank(buffer.info);
+            if (target == nullptr || rank > target_rank) {
+                target = &buffer;
+                target_rank = rank;
+            }
+        }
+
+        target->info = nullptr;
+        LoadScreenshot(info, target->screenshot);
+        target->info = info;
+
+        const ImageJob &top = image_jobs[kTop];
+        target->native_top = !top.error && top.info.width == top.img.subtex->width && top.info.height == top.img.subtex->height;
+        return *target;
+    }
+
+    // Hands the top image of the screenshot shown to top_image_hook, which takes one at a time: the preloaded ones are
+    // not handed, so they never take the place of the one shown. The shown buffer is not written while it is shown.
+    void ShareTopImage(const Buffer &buffer) {
+        if (top_image_hook && buffer.native_top) top_image_hook(buffer.info, buffer.screenshot->top);
+    }
+
     void ThreadMain() {
         while (run_thread) {
-            auto next_info = next_screenshot_info.load();
+            if (Request *next = next_request.exchange(nullptr)) {
+                request = std::move(*next);
+                delete next;
+                handed = false;
+            }
 
-            if (next_info != nullptr) {
-                if (next_info != loading_screenshot_info) {
-                    loading_screenshot_info = next_info;
-                    loading_screenshot_callback = next_screenshot_callback;
+            if (!handed) {
+                handed = true;
 
-                    LoadScreenshot(loading_screenshot_info);
+                Buffer *buffer = Find(request.info);
+                if (buffer == nullptr) {
+                    missed_screenshots = missed_screenshots + 1;
+                    buffer = &LoadBuffer(request.info);
+                }
 
-                    loading_screenshot_callback(screenshot_buffer[current_buffer]);
+                shown_buffer = buffer;
+                request.callback(buffer->screenshot);
 
-                    last_buffer = current_buffer;
-                    current_buffer = (current_buffer + 1) % num_buffers;
-                } else {
-                    loading_screenshot_callback(screenshot_buffer[last_buffer]);
-                }
+                // After the callback, so the screenshot shows first
+                ShareTopImage(*buffer);
+                continue;
+            }
+
+            // Then the neighbours, one at a time so a new request is served after the one loading
+            auto missing = std::find_if(request.neighbours.begin(), request.neighbours.end(), [this](info_ptr info) { return Find(info) == nullptr; });
+            if (missing != request.neighbours.end()) {
+                LoadBuffer(*missing);
+                continue;
             }
 
             svcWaitSynchronization(loadScreenshotRequest, U64_MAX);
@@ -93,9 +198,13 @@ class ScreenshotThread {
     }
 
    public:
-    ScreenshotThread() {
-        for (int i = 0; i < num_buffers; i++) {
-            screenshot_buffer[i] = new Screenshot({
+    // Keeps num_buffers screenshots loaded, at least 2: the one shown and num_buffers - 1 of its neighbours
+    ScreenshotThread(DecodePool &pool, size_t num_buffers, void (*top_image_hook)(info_ptr, C2D_Image) = nullptr) : pool(pool), top_image_hook(top_image_hook) {
+        for (auto &job : image_jobs) job.thread = this;
+
+        buffers.resize(std::max<size_t>(2, num_buffers));
+        for (auto &buffer : buffers) {
+            buffer.screenshot = new Screenshot({
                 false,
                 ui::CreateImage(ui::kTopScreenWidth, ui::kTopScreenHeight),
                 ui::CreateImage(ui::kTopScreenWidth, ui::kTopScreenHeight),
@@ -109,19 +218,26 @@ class ScreenshotThread {
     ~ScreenshotThread() {
         Stop();
 
-        for (auto &screenshot : screenshot_buffer) {
-            delete screenshot;
+        for (auto &buffer : buffers) {
+            delete buffer.screenshot;
         }
     }
 
-    void Load(info_ptr screenshot_info, void (*callback)(screenshot_ptr)) {
+    size_t NumMissedScreenshots() { return missed_screenshots; }
+
+    // Neighbours "Load" preloads at most
+    size_t NumNeighbours() { return buffers.size() - 1; }
+
+    // Gives the screenshot to the callback, right away from the thread when it is already loaded. Then preloads the
+    // neighbours in order, the first NumNeighbours() of them, so they are ready when they are requested in turn.
+    void Load(info_ptr screenshot_info, void (*callback)(screenshot_ptr), std::vector<info_ptr> neighbours = {}) {
         if (screenshot_info == nullptr) {
             callback(nullptr);
             return;
         }
 
-        next_screenshot_info = screenshot_info;
-        next_screenshot_callback = callback;
+        neighbours.resize(std::min(neighbours.size(), NumNeighbours()));
+        delete next_request.exchange(new Request{screenshot_info, callback, std::move(neighbours)});
 
         svcClearEvent(loadScreenshotRequest);
         svcSignalEvent(loadScreenshotRequest);
@@ -130,7 +246,6 @@ class ScreenshotThread {
     void Stop() {
         if (!run_thread) return;
 
-        next_screenshot_info = nullptr;
         run_thread = false;
 
         svcClearEvent(loadScreenshotRequest);
@@ -140,16 +255,23 @@ class ScreenshotThread {
         threadFree(loadScreenshotThread);
 
         svcCloseHandle(loadScreenshotRequest);
+        svcCloseHandle(imagesDecoded);
+
+        delete next_request.exchange(nullptr);
     }
 
+    // Forgets the loaded screenshots, their files may have changed while the thread was stopped
     void Start() {
         if (run_thread) return;
 
-        next_screenshot_info = nullptr;
+        request = Request();
+        handed = true;
+        for (auto &buffer : buffers) buffer.info = nullptr;
 
         s32 prio = 0;
         svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
         svcCreateEvent(&loadScreenshotRequest, RESET_ONESHOT);
+        svcCreateEvent(&imagesDecoded, RESET_ONESHOT);
         run_thread = true;
 
         size_t stackSize = (4 * 1024);
@@ -2,154 +2,518 @@
 #ifndef THREADS_THUMBNAIL_THREAD_HPP_
 #define THREADS_THUMBNAIL_THREAD_HPP_
 
+#include <math.h>
+
 #include <algorithm>
 #include <atomic>
 #include <iostream>
 #include <limits>
-#include <list>
-#include <map>
+#include <memory>
 #include <utility>
 #include <vector>
 
+#include "decode_pool.hpp"
 #include "loadbmp.hpp"
 #include "screenshots.hpp"
+#include "settings.hpp"
+#include "thumbnail_atlas.hpp"
+#include "thumbnail_format.hpp"
+#include "thumbnail_store.hpp"
 #include "ui.hpp"
 
 namespace screenshots::threads {
 
 class ThumbnailThread {
    private:
-    struct ThumbnailCache {
-        C2D_Image image;
-        size_t last_usage = 0;
-        mutable_info_ptr assigned_screenshot;
-
-        explicit ThumbnailCache(mutable_info_ptr info) : assigned_screenshot(info) { image = ui::CreateImage(ui::kThumbnailWidth, ui::kThumbnailHeight); }
-        ThumbnailCache(const ThumbnailCache &) = delete;
-        ThumbnailCache &operator=(const ThumbnailCache &other) = delete;
-        ThumbnailCache &operator=(const ThumbnailCache &&other) = delete;
-
-        ~ThumbnailCache() {
-            if (image.tex != nullptr || image.subtex != nullptr) {
-                C3D_TexDelete(image.tex);
-                delete image.tex;
-                delete image.subtex;
-            }
-        }
-        ThumbnailCache(ThumbnailCache &&other) : image(std::move(other.image)), last_usage(other.last_usage), assigned_screenshot(other.assigned_screenshot) {
-            other.image.tex = nullptr;
-            other.image.subtex = nullptr;
-        }
+    // Entry of the thumbnail cache, linked to the previous and next used entries by index
+    struct ThumbnailSlot {
+        C2D_Image image = {nullptr, nullptr};
+        mutable_info_ptr assigned_screenshot = nullptr;
+        u32 prev = kNoThumbnailSlot;
+        u32 next = kNoThumbnailSlot;
+        bool decoding = false;  // Out of the used list until its decode job is finished
     };
 
+    // Thumbnail decoded on a pool worker, finished by the thumbnail thread once done is set
+    struct ThumbnailJob : public DecodeJob {
+        ThumbnailThread *thread = nullptr;
+        mutable_info_ptr info = nullptr;  // nullptr while the job is free
+        C2D_Image image = {nullptr, nullptr};
+        ThumbnailStore::FileKey key;
+        u64 start_tick = 0;
+        unsigned int error = LOADBMP_NO_ERROR;
+        std::atomic<bool> done = false;
+
+        void Run(size_t worker, bmp_reader &reader) override { thread->Decode(*this, worker, reader); }
+    };
+
+    // What the UI thread reads of a slot, without locks. The thread bumps the generation before reusing the slot and
+    // waits for the frame the UI last drew it in to be done.
+    struct PublishedSlot {
+        C2D_Image image = {nullptr, nullptr};
+        std::atomic<u32> generation = 1;  // Never 0, so no handle is kNoThumbnail
+        std::atomic<u32> drawn_frame = kNeverDrawn;
+    };
+
+    static constexpr u32 kNeverDrawn = UINT32_MAX;
+
+    static_assert(ui::kThumbnailDownscale == LOADBMP_THUMBNAIL_DOWNSCALE, "Thumbnail box filter must match the thumbnail downscale");
+
     static constexpr size_t kThumbnailsPerPage = 9;
 
-    // Number of thumbnails to load around the thumbnail_cache_iterator screenshot
-    static constexpr size_t kCacheRange = kThumbnailsPerPage * 15;
-    // Distance from thumbnail_cache_iterator that a thumbnail requested with "Load" must be to replace the thumbnail_cache_iterator with it
-    static constexpr size_t kCacheBoundary = kThumbnailsPerPage * 5;
+    // Pages of thumbnails to load on each side of the visible page, fewer when the cache cannot hold them all
+    static constexpr size_t kCachePages = 15;
+    // Relative change of the scroll speed that has the thread plan again
+    static constexpr float kScrollSpeedChange = 0.25f;
 
     /*
-     * (cache_iter - kCacheRange) === (cache_iter - kCacheBoundary) === cache_iter === (cache_iter + kCacheBoundary) === (cache_iter + kCacheRange)
-     *             ^                              ^                                                ^                                 ^
-     *             |                              |________________________________________________|                                 |
-     *             |      "SetCurrent" calls outside this range replaces cache_iter and starts loading thumbnails from there         |
-     *             |                                                                                                                 |
-     *             |_________________________________________________________________________________________________________________|
-     *        "ThreadMain" load thumbnails in this range, starting from cache_iter and alternating between screenshots in the neightborhood
+     * Thumbnails are loaded by priority: the visible page first, then the pages around it by distance, the page ahead in
+     * the scroll direction before the one behind at the same distance. When scrolling forward:
+     *
+     *    ... === page - 2 === page - 1 === page === page + 1 === page + 2 === ...
+     *               4            2          0          1            3
      *
+     * When "SetScroll" reports a scroll, the range moves ahead as the scroll gets closer to passing a page per page of
+     * thumbnails loaded, and distances are measured relative to the side they are on, so 8 pages ahead and 2 behind
+     * load as +1 +2 +3 -1 +4 +5 +6 -2 +7 +8.
+     *
+     * "SetCurrent" or "SetScroll" on another page has the thread plan its jobs again, dropping the ones no longer in
+     * range. The plan is checked before every thumbnail, so a jump waits for one load at most.
      */
 
-    // Max cache size
-    static constexpr size_t kMaxThumbnails = std::max(kCacheRange * 2 + 1, 1000U);
+    static constexpr size_t kThumbnailsPerAtlasPage = ThumbnailAtlas::CellsPerPage(ui::kThumbnailWidth, ui::kThumbnailHeight);
+
+    // Linear memory left to the rest of the app: a set of screenshot textures (two 512x256 top and a 512x256 bottom
+    // RGB8 texture) and citro2d's buffers
+    static constexpr size_t kLinearReserve = 3 * 512 * 256 * 3 + 1024 * 1024;
+    // Frames after the one a thumbnail was drawn in before its slot may be written: the frame being submitted and the
+    // one the GPU may still draw
+    static constexpr u32 kFramesInFlight = 2;
+    // Longest wait for those frames once "Stop" is called: the UI thread is in it and submits no more frames, so only the
+    // GPU has to finish the ones in flight
+    static constexpr s64 kStoppedFramesTimeout = 50 * 1000 * 1000;
+
+    // Linear memory the cache may take: what is free at startup minus kLinearReserve
+    static size_t Budget() {
+        size_t free_space = linearSpaceFree();
+        return free_space > kLinearReserve ? free_space - kLinearReserve : 0;
+    }
+
+    // Max cache size: as many atlas pages as fit the budget, at least one
+    static size_t MaxThumbnails(size_t budget, ThumbnailFormat format) {
+        return std::max<size_t>(1, budget / ThumbnailAtlas::PageSize(TextureColor(format))) * kThumbnailsPerAtlasPage;
+    }
 
-    using mutable_info_ptr_iterator = std::vector<screenshots::mutable_info_ptr>::iterator;
+    // Screenshots in the order they are shown, the thread's own copy. Thumbnails belong to the screenshots and not to
+    // their position, so a new order keeps every cached thumbnail.
+    std::vector<mutable_info_ptr> order;
+    // Set by "SetScreenshots", taken by the thread when it plans again
+    std::atomic<std::vector<mutable_info_ptr> *> next_order = nullptr;
 
-    mutable_info_ptr_iterator screenshot_container_start;
-    mutable_info_ptr_iterator screenshot_container_end;
+    // Slots are added up to max_thumbnails, then the least recently used one is reused.
+    // The used list runs from the least (lru_head) to the most (lru_tail) recently used slot.
+    std::vector<ThumbnailSlot> slots;
+    u32 lru_head = kNoThumbnailSlot;
+    u32 lru_tail = kNoThumbnailSlot;
 
-    std::list<ThumbnailCache> thumbnails_cache;
-    std::map<mutable_info_ptr, std::list<ThumbnailCache>::iterator> screenshots_in_cache;
+    // Set by "SetCurrent", "SetScroll" and "SetScreenshots", the thread plans again when thumbnail_cache_tick changes
     std::atomic<size_t> thumbnail_cache_tick = 0;
+    std::atomic<size_t> current_page = 0;
+    std::atomic<int> scroll_direction = 1;
+    // In pages per second
+    std::atomic<float> scroll_speed = 0;
+    // Average time to load a page of thumbnails that are not cached
+    float page_load_seconds = 0;
 
-    std::vector<screenshots::mutable_info_ptr>::iterator thumbnail_cache_iterator;
+    // Indexes of the thumbnails left to load, from the lowest to the highest priority
+    std::vector<size_t> jobs;
 
     std::atomic<bool> loading_thumbnails = false;
     std::atomic<bool> run_thread = false;
     std::atomic<int> loaded_thumbs = 0;
 
+    ThumbnailStore &store;
+
+    // A decode job for each worker, the thread keeps at most that many thumbnails decoding
+    DecodePool &pool;
+    std::unique_ptr<ThumbnailJob[]> decode_jobs = std::make_unique<ThumbnailJob[]>(pool.NumWorkers());
+    size_t decoding = 0;
+
+    ThumbnailFormat format = settings::GetThumbnailFormat();
+    size_t budget = Budget();
+    size_t max_thumbnails = MaxThumbnails(budget, format);
+    ThumbnailAtlas atlas{ui::kThumbnailWidth, ui::kThumbnailHeight, max_thumbnails, TextureColor(format)};
+    // Sized once, the capacity only ever shrinks, so the UI thread never reads a slot being destroyed
+    std::unique_ptr<PublishedSlot[]> published = std::make_unique<PublishedSlot[]>(max_thumbnails);
+    // Frames submitted by the UI thread
+    std::atomic<u32> frame = 0;
+    // Thumbnails are decoded to these RGB8 images first when the atlas is in another format, one for each worker
+    std::vector<C2D_Image> decoded;
+    // Thumbnail taken from a screenshot the screenshot thread loaded, written by "AddFromImage" while derived_info is
+    // nullptr and read by the thread until it sets it back
+    C2D_Image derived = ui::CreateImage(ui::kThumbnailWidth, ui::kThumbnailHeight);
+    std::atomic<info_ptr> derived_info = nullptr;
+
+    std::atomic<thumbnail_cache_hook> cache_hook;
+    size_t evictions = 0;
+
     Thread thumbnailThread;
     Handle loadThumbnailRequest;
 
-    void LoadThumbnail(mutable_info_ptr info) {
-        if (screenshots_in_cache.contains(info)) {
-            screenshots_in_cache[info]->last_usage = thumbnail_cache_tick;
-            thumbnails_cache.splice(thumbnails_cache.end(), thumbnails_cache, screenshots_in_cache[info]);
-            return;
+    void Report(ThumbnailCacheEvent event) {
+        thumbnail_cache_hook hook = cache_hook;
+        if (hook) hook(event, ThumbnailCacheStats{budget, max_thumbnails, slots.size(), atlas.NumPages(), evictions});
+    }
+
+    void Evict(u32 slot) {
+        mutable_info_ptr screenshot = slots[slot].assigned_screenshot;
+        screenshot->thumbnail.store(kNoThumbnail, std::memory_order_release);
+        screenshot->thumbnail_slot = kNoThumbnailSlot;
+        published[slot].generation++;
+
+        evictions++;
+        Report(kCacheEviction);
+    }
+
+    // Stops the cache from growing into kLinearReserve and gives back the last page when other allocations already did
+    void CheckMemoryPressure() {
+        size_t free_space = linearSpaceFree();
+        bool needs_new_page = slots.size() > 0 && slots.size() < max_thumbnails && slots.size() % kThumbnailsPerAtlasPage == 0;
+        if (needs_new_page && free_space < kLinearReserve + ThumbnailAtlas::PageSize(TextureColor(format))) {
+            max_thumbnails = slots.size();
+            Report(kCacheCapacity);
         }
 
-        if (thumbnails_cache.size() < kMaxThumbnails) {
-            thumbnails_cache.push_back(ThumbnailCache(info));
-        } else {
-            ThumbnailCache oldest_thumbnail = std::move(thumbnails_cache.front());
-            thumbnails_cache.pop_front();
+        if (free_space >= kLinearReserve || atlas.NumPages() <= 1) return;
 
-            oldest_thumbnail.assigned_screenshot->thumbnail = nullptr;
-            oldest_thumbnail.assigned_screenshot->has_thumbnail = false;
-            screenshots_in_cache.erase(oldest_thumbnail.assigned_screenshot);
+        // Slots still decoding are not in the used list
+        WaitDecodes();
 
-            thumbnails_cache.push_back(std::move(oldest_thumbnail));
+        size_t first_slot = (atlas.NumPages() - 1) * kThumbnailsPerAtlasPage;
+        size_t last_slot = slots.size();
+        for (size_t slot = first_slot; slot < last_slot; slot++) {
+            Unlink(slot);
+            Evict(slot);
         }
-        ThumbnailCache *thumbnail = &thumbnails_cache.back();
+        slots.resize(first_slot);
+        max_thumbnails = first_slot;
+
+        WaitFramesDone(first_slot, last_slot);
+        atlas.ReleaseLastPage();
+        Report(kCacheCapacity);
+    }
+
+    // Whether the frames that drew the slot are done
+    bool FramesDone(size_t slot) {
+        u32 drawn = published[slot].drawn_frame;
+        return drawn == kNeverDrawn || frame - drawn >= kFramesInFlight;
+    }
 
-        info->has_thumbnail = false;
-        unsigned int error = loadbmp_to_image(info->path_top, thumbnail->image);
-        info->thumbnail = &thumbnail->image;
-        info->has_thumbnail = !error;
+    // Waits for the frames that drew the evicted slots [first, last) to be done. While the thread runs there is no
+    // timeout, however long the UI thread stalls or is suspended, so a slot is never written under a frame in flight.
+    void WaitFramesDone(size_t first, size_t last) {
+        u64 deadline = 0;
+        for (size_t slot = first; slot < last; slot++) {
+            while (!FramesDone(slot)) {
+                if (!run_thread) {
+                    u64 now = svcGetSystemTick();
+                    if (deadline == 0) deadline = now + kStoppedFramesTimeout * (SYSCLOCK_ARM11 / 1000000) / 1000;
+                    if (now >= deadline) break;
+                }
+                svcSleepThread(1000 * 1000);
+            }
+        }
+    }
 
-        thumbnail->last_usage = thumbnail_cache_tick;
-        thumbnail->assigned_screenshot = info;
-        screenshots_in_cache[info] = --thumbnails_cache.end();
+    void Unlink(u32 slot) {
+        ThumbnailSlot &entry = slots[slot];
+        (entry.prev != kNoThumbnailSlot ? slots[entry.prev].next : lru_head) = entry.next;
+        (entry.next != kNoThumbnailSlot ? slots[entry.next].prev : lru_tail) = entry.prev;
+    }
+
+    void PushBack(u32 slot) {
+        ThumbnailSlot &entry = slots[slot];
+        entry.prev = lru_tail;
+        entry.next = kNoThumbnailSlot;
+        (lru_tail != kNoThumbnailSlot ? slots[lru_tail].next : lru_head) = slot;
+        lru_tail = slot;
+    }
+
+    // Links the slot of a loaded thumbnail into the used list and shows it
+    void FinishThumbnail(u32 slot, unsigned int error) {
+        ThumbnailSlot &thumbnail = slots[slot];
+        thumbnail.decoding = false;
+        PushBack(slot);
+
+        // The texture is written before the handle is released
+        published[slot].image = thumbnail.image;
+        if (!error) {
+            thumbnail_handle handle = static_cast<thumbnail_handle>(published[slot].generation.load(std::memory_order_relaxed)) << 32 | slot;
+            thumbnail.assigned_screenshot->thumbnail.store(handle, std::memory_order_release);
+        }
 
         loaded_thumbs = loaded_thumbs + 1;
     }
 
+    // seconds is the time a thumbnail took to load, divided by the number of thumbnails loading at once
+    void AddLoadTime(float seconds) { page_load_seconds += (seconds * kThumbnailsPerPage - page_load_seconds) / 16; }
+
+    // Runs on a pool worker
+    void Decode(ThumbnailJob &job, size_t worker, bmp_reader &reader) {
+        C2D_Image target = decoded.empty() ? job.image : decoded[worker];
+        if (settings::SmoothThumbnails()) {
+            job.error = loadbmp_to_thumbnail(reader, job.info->path_top.c_str(), target);
+        } else {
+            job.error = loadbmp_to_image(reader, job.info->path_top.c_str(), target);
+        }
+        if (!job.error && !decoded.empty()) EncodeImage(decoded[worker], job.image);
+
+        job.done.store(true, std::memory_order_release);
+        svcSignalEvent(loadThumbnailRequest);
+    }
+
+    // Saves and shows the thumbnails the workers are done with
+    void FinishDecodes() {
+        for (size_t i = 0; i < pool.NumWorkers(); i++) {
+            ThumbnailJob &job = decode_jobs[i];
+            if (job.info == nullptr || !job.done.load(std::memory_order_acquire)) continue;
+
+            if (!job.error) store.Save(job.info->name, job.key, job.image);
+            AddLoadTime(static_cast<float>(svcGetSystemTick() - job.start_tick) / SYSCLOCK_ARM11 / pool.NumWorkers());
+            FinishThumbnail(job.info->thumbnail_slot, job.error);
+
+            job.info = nullptr;
+            job.done = false;
+            decoding--;
+        }
+    }
+
+    void WaitDecodes() {
+        while (decoding > 0) {
+            svcWaitSynchronization(loadThumbnailRequest, U64_MAX);
+            FinishDecodes();
+        }
+    }
+
+    // Gives a slot to a screenshot without a thumbnail: a new one while the cache grows, otherwise the least recently
+    // used one whose frames are done, or the least recently used one once they are. kNoThumbnailSlot when every slot is
+    // decoding.
+    u32 AssignSlot(mutable_info_ptr info) {
+        CheckMemoryPressure();
+
+        u32 slot = kNoThumbnailSlot;
+        if (slots.size() < max_thumbnails) {
+            C2D_Image image = atlas.Image(slots.size());
+            if (image.tex) {
+                slot = slots.size();
+                slots.emplace_back();
+                slots[slot].image = image;
+            } else {
+                // Out of linear memory for another page
+                max_thumbnails = slots.size();
+                Report(kCacheCapacity);
+            }
+        }
+        if (slot == kNoThumbnailSlot) {
+            if (lru_head == kNoThumbnailSlot) return kNoThumbnailSlot;
+
+            slot = lru_head;
+            for (u32 used = lru_head; used != kNoThumbnailSlot; used = slots[used].next) {
+                if (FramesDone(used)) {
+                    slot = used;
+                    break;
+                }
+            }
+            Unlink(slot);
+            Evict(slot);
+        }
+        WaitFramesDone(slot, slot + 1);
+
+        slots[slot].assigned_screenshot = info;
+        info->thumbnail_slot = slot;
+        return slot;
+    }
+
+    // Touches a cached thumbnail, or loads it from the store or has a worker decode it. Decoding must be below the
+    // number of workers.
+    void LoadThumbnail(mutable_info_ptr info) {
+        if (info->thumbnail_slot != kNoThumbnailSlot) {
+            if (!slots[info->thumbnail_slot].decoding && info->thumbnail_slot != lru_tail) {
+                Unlink(info->thumbnail_slot);
+                PushBack(info->thumbnail_slot);
+            }
+            return;
+        }
+
+        u32 slot = AssignSlot(info);
+        if (slot == kNoThumbnailSlot) return;
+        ThumbnailSlot *thumbnail = &slots[slot];
+
+        u64 start_tick = svcGetSystemTick();
+        ThumbnailStore::FileKey key;
+        if (store.Load(info->name, info->path_top, thumbnail->image, key)) {
+            AddLoadTime(static_cast<float>(svcGetSystemTick() - start_tick) / SYSCLOCK_ARM11);
+            FinishThumbnail(slot, LOADBMP_NO_ERROR);
+            return;
+        }
+
+        ThumbnailJob *job = std::find_if(&decode_jobs[0], &decode_jobs[pool.NumWorkers()], [](const ThumbnailJob &job) { return job.info == nullptr; });
+        job->info = info;
+        job->image = thumbnail->image;
+        job->key = key;
+        job->start_tick = start_tick;
+        thumbnail->decoding = true;
+        decoding++;
+
+        pool.Submit(*job, kThumbnailJob);
+    }
+
+    // Caches the thumbnail "AddFromImage" took, unless the screenshot got one meanwhile or is no longer shown (it may
+    // have been deleted, so it is only compared). Saved to the store unless it already has it.
+    void AddDerived(info_ptr screenshot) {
+        auto it = std::find(order.begin(), order.end(), screenshot);
+        if (it == order.end() || (*it)->thumbnail_slot != kNoThumbnailSlot) return;
+
+        mutable_info_ptr info = *it;
+        u32 slot = AssignSlot(info);
+        if (slot == kNoThumbnailSlot) return;
+
+        C2D_Image image = slots[slot].image;
+        EncodeImage(derived, image);
+
+        ThumbnailStore::FileKey key;
+        if (!store.Contains(info->name, info->path_top, key)) store.Save(info->name, key, image);
+        FinishThumbnail(slot, LOADBMP_NO_ERROR);
+        Report(kCacheDerived);
+    }
+
+    // Pages on each side of the visible one that fit the cache
+    size_t CachePages() {
+        size_t pages = max_thumbnails / kThumbnailsPerPage;
+        return pages > 0 ? std::min(kCachePages, (pages - 1) / 2) : 0;
+    }
+
+    // Thumbnails of a page not in the cache, SIZE_MAX for pages out of the screenshots
+    size_t MissingThumbnails(size_t page, ptrdiff_t offset) {
+        size_t count = order.size();
+        if (offset < 0 && static_cast<size_t>(-offset) > page) return SIZE_MAX;
+
+        size_t first = (page + offset) * kThumbnailsPerPage;
+        if (first >= count) return SIZE_MAX;
+
+        size_t missing = 0;
+        for (size_t i = first; i < std::min(count, first + kThumbnailsPerPage); i++) {
+            missing += order[i]->thumbnail_slot == kNoThumbnailSlot;
+        }
+        return missing;
+    }
+
+    // Queues the missing thumbnails around the visible page and touches the cached ones, from the lowest priority up,
+    // so the thumbnails furthest from the visible page, and behind it first, are the first evicted
+    void PlanJobs() {
+        jobs.clear();
+        CheckMemoryPressure();
+
+        size_t page = current_page;
+        int direction = scroll_direction;
+
+        // Pages the scroll passes while a page of thumbnails loads
+        float stride = scroll_speed * page_load_seconds;
+
+        // All the pages but one are ahead from a stride of one
+        size_t range = CachePages() * 2;
+        size_t ahead = range / 2 + static_cast<size_t>((range > 0 ? range / 2 - 1 : 0) * std::min(1.0f, stride));
+        size_t behind = range - ahead;
+
+        struct PlannedPage {
+            ptrdiff_t offset;
+            float priority;
+            size_t missing;
+        };
+        PlannedPage planned[kCachePages * 2 + 1];
+        size_t num_planned = 0;
+        // Whether the page is in the screenshots and was added
+        auto plan = [&](ptrdiff_t offset, float priority) {
+            size_t missing = MissingThumbnails(page, offset);
+            if (missing == SIZE_MAX) return false;
+
+            planned[num_planned++] = {offset, priority, missing};
+            return true;
+        };
+
+        // The pages the scroll reaches before their thumbnails could be loaded go last, after the visible page. Going
+        // from the visible page ahead, a page is reached in time if the thumbnails missing up to it load before the
+        // scroll passes as many pages as it is away.
+        float pages_to_load = 0;
+        auto reached = [&](size_t distance) {
+            float loaded_at = stride * (pages_to_load + static_cast<float>(planned[num_planned - 1].missing) / kThumbnailsPerPage);
+            if (loaded_at > std::max<size_t>(distance, 1)) return false;
+
+            pages_to_load += static_cast<float>(planned[num_planned - 1].missing) / kThumbnailsPerPage;
+            return true;
+        };
+
+        if (plan(0, 0.0f) && !reached(0)) planned[num_planned - 1].priority = 1.0f;
+        for (size_t distance = 1; distance <= ahead; distance++) {
+            if (plan(direction * static_cast<ptrdiff_t>(distance), distance / (ahead + 1.0f)) && !reached(distance)) planned[num_planned - 1].priority += 1.0f;
+        }
+        for (size_t distance = 1; distance <= behind; distance++) {
+            // Slightly lower, so the page ahead goes first at the same relative distance
+            plan(-direction * static_cast<ptrdiff_t>(distance), distance / (behind + 1.0f) + 1e-3f);
+        }
+
+        // From the lowest priority up
+        std::stable_sort(planned, planned + num_planned, [](const PlannedPage &a, const PlannedPage &b) { return a.priority > b.priority; });
+
+        for (size_t p = 0; p < num_planned; p++) {
+            size_t first = (page + planned[p].offset) * kThumbnailsPerPage;
+            for (size_t i = std::min(order.size(), first + kThumbnailsPerPage); i-- > first;) {
+                mutable_info_ptr info = order[i];
+                if (info->thumbnail_slot != kNoThumbnailSlot) {
+                    LoadThumbnail(info);
+                } else {
+                    jobs.push_back(i);
+                }
+            }
+        }
+    }
+
     void ThreadMain() {
+        size_t planned_tick = 0;
         while (run_thread) {
-            if (thumbnail_cache_tick != 0) {
-                loading_thumbnails = true;
-
-                auto cache_iterator = thumbnail_cache_iterator;
-                for (size_t i = 0; i < kCacheRange; i++) {
-                    if (!run_thread) {
-                        return;
-                    }
-
-                    if (cache_iterator == thumbnail_cache_iterator) {
-                        // Skip thumbnail requests to the current cache_iterator
-                        svcClearEvent(loadThumbnailRequest);
-                    } else {
-                        // Break and start loading from the new iterator
-                        break;
-                    }
-
-                    if (cache_iterator + i < screenshot_container_end) {
-                        LoadThumbnail(*(cache_iterator + i));
-                    }
-
-                    size_t previous_page_offset =
-                        i > 0 ? ((i - 1) / kThumbnailsPerPage) * kThumbnailsPerPage + (kThumbnailsPerPage - ((i - 1) % kThumbnailsPerPage)) : 0;
-
-                    if (cache_iterator - previous_page_offset >= screenshot_container_start && i != 0) {
-                        LoadThumbnail(*(cache_iterator - previous_page_offset));
-                    }
+            if (thumbnail_cache_tick != planned_tick) {
+                planned_tick = thumbnail_cache_tick;
+                if (std::vector<mutable_info_ptr> *screenshots = next_order.exchange(nullptr)) {
+                    order.swap(*screenshots);
+                    delete screenshots;
                 }
-                loading_thumbnails = false;
+                PlanJobs();
+            }
+
+            if (info_ptr info = derived_info.load(std::memory_order_acquire)) {
+                AddDerived(info);
+                derived_info.store(nullptr, std::memory_order_release);
             }
 
+            FinishDecodes();
+
+            if (!jobs.empty() && decoding < pool.NumWorkers()) {
+                loading_thumbnails = true;
+                size_t index = jobs.back();
+                jobs.pop_back();
+                LoadThumbnail(order[index]);
+                continue;
+            }
+            loading_thumbnails = decoding > 0;
+
+            // Compact the store while idle, one thumbnail at a time so a new request is served right away
+            if (decoding == 0 && planned_tick != 0 && planned_tick == thumbnail_cache_tick && store.Compact()) continue;
+
+            // Also signaled by the workers, so it is not cleared after waking up
             svcWaitSynchronization(loadThumbnailRequest, U64_MAX);
-            svcClearEvent(loadThumbnailRequest);
         }
+
+        WaitDecodes();
     }
 
     static void ThreadEntrypointFn(void *arg) {
@@ -158,30 +522,102 @@ class ThumbnailThread {
     }
 
    public:
-    explicit ThumbnailThread(mutable_info_ptr_iterator screenshot_container_start, mutable_info_ptr_iterator screenshot_container_end) {
-        Start(screenshot_container_start, screenshot_container_end);
+    ThumbnailThread(ThumbnailStore &store, DecodePool &pool, thumbnail_cache_hook cache_hook, const std::vector<mutable_info_ptr> &screenshots)
+        : order(screenshots), store(store), pool(pool), cache_hook(cache_hook) {
+        // Reserved up front so thumbnail images never move and touching or evicting them never allocates
+        slots.reserve(max_thumbnails);
+        for (size_t i = 0; i < pool.NumWorkers(); i++) {
+            decode_jobs[i].thread = this;
+            if (format != kThumbnailRGB8) decoded.push_back(ui::CreateImage(ui::kThumbnailWidth, ui::kThumbnailHeight));
+        }
+        Report(kCacheCapacity);
+        Start();
     }
 
-    ~ThumbnailThread() { Stop(); }
+    ~ThumbnailThread() {
+        Stop();
+        delete next_order.load();
+
+        for (auto &slot : slots) {
+            slot.assigned_screenshot->thumbnail = kNoThumbnail;
+            slot.assigned_screenshot->thumbnail_slot = kNoThumbnailSlot;
+        }
+
+        for (auto &image : decoded) {
+            C3D_TexDelete(image.tex);
+            delete image.tex;
+            delete image.subtex;
+        }
+        C3D_TexDelete(derived.tex);
+        delete derived.tex;
+        delete derived.subtex;
+    }
 
     size_t NumLoadedThumbnails() { return loaded_thumbs; }
 
-    void SetCurrent(mutable_info_ptr_iterator new_current_iterator) {
-        if (screenshot_container_start == screenshot_container_end) return;
+    // Called from the UI thread
+    const C2D_Image *Acquire(thumbnail_handle handle) {
+        if (handle == kNoThumbnail) return nullptr;
 
-        if (thumbnail_cache_tick != 0) {
-            size_t distance = std::abs(std::distance(thumbnail_cache_iterator, new_current_iterator));
+        // Marked before checking the generation: an eviction either bumps the generation first and the check fails, or
+        // sees the mark and waits for the frame to be done before writing the slot
+        PublishedSlot &slot = published[static_cast<u32>(handle)];
+        slot.drawn_frame = frame.load(std::memory_order_relaxed);
+        if (slot.generation != handle >> 32) return nullptr;
 
-            if (distance < kCacheBoundary) {
-                return;
-            }
+        return &slot.image;
+    }
+
+    void EndFrame() { frame++; }
+
+    void SetCacheHook(thumbnail_cache_hook hook) { cache_hook = hook; }
+
+    void SetCurrent(size_t index) {
+        size_t page = index / kThumbnailsPerPage;
+        if (thumbnail_cache_tick != 0) {
+            if (page == current_page) return;
+            scroll_direction = page > current_page ? 1 : -1;
         }
 
-        thumbnail_cache_iterator = new_current_iterator;
+        current_page = page;
+        thumbnail_cache_tick++;
+        svcSignalEvent(loadThumbnailRequest);
+    }
+
+    void SetScroll(size_t page, float pages_per_second) {
+        float speed = std::abs(pages_per_second);
+        int direction = pages_per_second == 0 ? scroll_direction.load() : (pages_per_second > 0 ? 1 : -1);
+        bool same_speed = std::abs(speed - scroll_speed) <= kScrollSpeedChange * scroll_speed;
+        if (thumbnail_cache_tick != 0 && page == current_page && direction == scroll_direction && same_speed) return;
+
+        current_page = page;
+        scroll_direction = direction;
+        scroll_speed = speed;
         thumbnail_cache_tick++;
         svcSignalEvent(loadThumbnailRequest);
     }
 
+    // Called from the screenshot thread with the top image of a screenshot it loaded, at the size of its bmp. When the
+    // screenshot has no thumbnail yet, downscales it in place of reading the bmp again and has the thread cache it.
+    // Skipped while the thread has not taken the previous one.
+    void AddFromImage(info_ptr info, C2D_Image image) {
+        if (!run_thread || derived_info.load(std::memory_order_acquire) != nullptr || info->thumbnail != kNoThumbnail) return;
+        if (loadbmp_image_to_thumbnail(image, derived, settings::SmoothThumbnails()) != LOADBMP_NO_ERROR) return;
+
+        derived_info.store(info, std::memory_order_release);
+        svcSignalEvent(loadThumbnailRequest);
+    }
+
+    // Has the thread plan again on a new order of the screenshots, without stopping it. The plan only queues the
+    // screenshots without a thumbnail, the others keep theirs wherever they moved.
+    void SetScreenshots(const std::vector<mutable_info_ptr> &screenshots) {
+        // An order the thread has not taken yet is replaced
+        delete next_order.exchange(new std::vector<mutable_info_ptr>(screenshots));
+
+        thumbnail_cache_tick++;
+        if (run_thread) svcSignalEvent(loadThumbnailRequest);
+    }
+
     void Stop() {
         if (!run_thread) return;
 
@@ -196,20 +632,20 @@ class ThumbnailThread {
         svcCloseHandle(loadThumbnailRequest);
     }
 
-    void Start(mutable_info_ptr_iterator screenshot_container_start, mutable_info_ptr_iterator screenshot_container_end) {
+    // The thread plans again when it starts if the screenshots or the current page changed while it was stopped
+    void Start() {
         if (run_thread) return;
 
-        this->screenshot_container_start = screenshot_container_start;
-        this->screenshot_container_end = screenshot_container_end;
-
-        thumbnail_cache_tick = 0;
+        jobs.clear();
+        derived_info = nullptr;
 
         s32 prio = 0;
         svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
         svcCreateEvent(&loadThumbnailRequest, RESET_ONESHOT);
         run_thread = true;
 
-        size_t stackSize = (4 * 1024);
+        // The thread also reads and writes the thumbnail store, through stdio and std::filesystem
+        size_t stackSize = (32 * 1024);
         thumbnailThread = threadCreate(ThreadEntrypointFn, this, stackSize, prio - 1, -2, false);
     }
 };
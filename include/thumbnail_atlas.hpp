@@ -0,0 +1,54 @@
+#ifndef THUMBNAIL_ATLAS_HPP_
+#define THUMBNAIL_ATLAS_HPP_
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <citro3d.h>
+
+#include <vector>
+
+namespace screenshots {
+
+// Thumbnails packed into shared texture pages, so they waste less texture memory than a power of two texture each and
+// thumbnails drawn one after the other use the same texture.
+//
+// Every thumbnail gets a cell of whole 8x8 tiles, so decoding one never touches the others. Cells are numbered in
+// page order and a page is created when its first cell is requested.
+class ThumbnailAtlas {
+   public:
+    static constexpr u16 kPageWidth = 1024;
+    static constexpr u16 kPageHeight = 512;
+
+    // Cells of width x height texels, in pages of the given format
+    ThumbnailAtlas(u16 width, u16 height, size_t num_cells, GPU_TEXCOLOR color = GPU_RGB8);
+    ~ThumbnailAtlas();
+
+    ThumbnailAtlas(const ThumbnailAtlas &) = delete;
+    ThumbnailAtlas &operator=(const ThumbnailAtlas &) = delete;
+
+    // Image of a cell, valid until its page is released. The image has no texture if its page could not be created.
+    C2D_Image Image(size_t cell);
+
+    // Frees the texture of the last page, its cells are created again when next requested
+    void ReleaseLastPage();
+
+    static constexpr u32 CellsPerPage(u16 width, u16 height) { return (kPageWidth / ((width + 7) & ~7)) * (kPageHeight / ((height + 7) & ~7)); }
+
+    // Bytes of a page
+    static size_t PageSize(GPU_TEXCOLOR color);
+
+    size_t NumPages() { return pages.size(); }
+
+   private:
+    u16 width;
+    u16 height;
+    GPU_TEXCOLOR color;
+    u32 columns;
+    u32 cells_per_page;
+
+    std::vector<C3D_Tex *> pages;
+    std::vector<Tex3DS_SubTexture> subtextures;
+};
+}  // namespace screenshots
+
+#endif  // THUMBNAIL_ATLAS_HPP_
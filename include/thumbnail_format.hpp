@@ -0,0 +1,34 @@
+#ifndef THUMBNAIL_FORMAT_HPP_
+#define THUMBNAIL_FORMAT_HPP_
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <citro3d.h>
+
+namespace screenshots {
+
+// Texture format thumbnails are kept in. The decoders write RGB8, other formats are encoded from it, trading quality
+// for more thumbnails in the same memory.
+enum ThumbnailFormat {
+    kThumbnailRGB8 = 0,    // 24 bpp, as decoded
+    kThumbnailRGB565 = 1,  // 16 bpp
+    kThumbnailETC1 = 2,    // 4 bpp, decoded by the GPU
+
+    kFirstThumbnailFormat = kThumbnailRGB8,
+    kLastThumbnailFormat = kThumbnailETC1,
+};
+
+GPU_TEXCOLOR TextureColor(ThumbnailFormat format);
+
+// Bytes of an 8x8 tile of a texture of one of the thumbnail formats
+u32 TileSize(GPU_TEXCOLOR color);
+
+// Encodes the tiles covered by the subtexture of an RGB8 image into the ones of img, an image of the same size in
+// any of the thumbnail formats
+void EncodeImage(C2D_Image rgb8, C2D_Image img);
+
+// Decodes img back into an RGB8 image of the same size, to measure what the encoding lost
+void DecodeImage(C2D_Image img, C2D_Image rgb8);
+}  // namespace screenshots
+
+#endif  // THUMBNAIL_FORMAT_HPP_
@@ -0,0 +1,88 @@
+#ifndef THUMBNAIL_STORE_HPP_
+#define THUMBNAIL_STORE_HPP_
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <citro3d.h>
+#include <stdio.h>
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace screenshots {
+
+// Thumbnails kept on the SD card between launches, as the raw (already tiled) data of the tiles of their texture
+// (see loadbmp_target), so a cached thumbnail is loaded with a single read.
+//
+// <path>.bin holds a header followed by fixed size slots of texture data, <path>.idx maps screenshot names to slots.
+// Entries are keyed by the size and modification time of the screenshot file, stale ones are dropped on lookup and
+// the holes they leave are compacted by moving the last slots into them.
+class ThumbnailStore {
+   public:
+    struct FileKey {
+        u64 size = 0;
+        u64 mtime = 0;
+    };
+
+    // Thumbnails of width x height texels in textures of the given format. variant identifies how thumbnails were
+    // produced (e.g. the downscale filter), a store of another variant or format is discarded.
+    ThumbnailStore(const std::string &path, u16 width, u16 height, GPU_TEXCOLOR color, u32 variant);
+    ~ThumbnailStore();
+
+    ThumbnailStore(const ThumbnailStore &) = delete;
+    ThumbnailStore &operator=(const ThumbnailStore &) = delete;
+
+    // Fills img when the store has an up to date thumbnail of the file at path.
+    // Otherwise returns false, and key is the key to Save the decoded thumbnail with.
+    bool Load(const std::string &name, const std::string &path, C2D_Image img, FileKey &key);
+    void Save(const std::string &name, const FileKey &key, C2D_Image img);
+    // Like Load without reading the thumbnail: whether the store has an up to date one, key is filled either way
+    bool Contains(const std::string &name, const std::string &path, FileKey &key);
+
+    // Drops the thumbnails of screenshots not in names
+    void Retain(const std::set<std::string> &names);
+
+    // Moves the last thumbnail into the first hole, returns false once there is nothing left to compact
+    bool Compact();
+
+    // Writes the index if it changed
+    void Flush();
+
+    size_t Count() { return entries.size(); }
+    size_t NumSlots() { return slot_names.size(); }
+
+   private:
+    struct Entry {
+        FileKey key;
+        u32 slot;
+    };
+
+    std::string index_path;
+    std::string data_path;
+    FILE *data = nullptr;
+
+    u32 variant;
+    u32 slot_size;
+    u16 width;
+    u16 height;
+    u32 format;
+    std::vector<u8> buffer;  // One slot, the tiles of a thumbnail are not contiguous in its texture
+
+    std::unordered_map<std::string, Entry> entries;
+    std::vector<std::string> slot_names;  // Name of the thumbnail in each slot, empty for holes
+    std::set<u32> free_slots;
+    bool index_dirty = false;
+    size_t saves_since_flush = 0;
+
+    void Reset();
+    bool LoadIndex();
+    void Drop(const std::string &name);
+    void TrimFreeSlots();
+    long SlotOffset(u32 slot);
+    bool MatchesTarget(C2D_Image img);
+};
+}  // namespace screenshots
+
+#endif  // THUMBNAIL_STORE_HPP_
@@ -0,0 +1,286 @@
+#include "io.hpp"
+
+#include <3ds.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef __3DS__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace io {
+
+#ifdef __3DS__
+Backend default_backend = kNative;
+#else
+Backend default_backend = kStdio;
+#endif
+size_t default_block_size = kDefaultBlockSize;
+
+class StdioReader : public Reader {
+   private:
+    FILE *file = nullptr;
+    std::vector<char> buffer;
+
+   public:
+    explicit StdioReader(size_t block_size) : buffer(block_size) {}
+    ~StdioReader() { close(); }
+
+    bool open(const char *filename) override {
+        close();
+        file = fopen(filename, "rb");
+        if (file == nullptr) return false;
+
+        setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+        return true;
+    }
+
+    void close() override {
+        if (file) fclose(file);
+        file = nullptr;
+    }
+
+    size_t read(void *dst, size_t size) override { return fread(dst, 1, size, file); }
+    bool seek(size_t offset) override { return fseek(file, offset, SEEK_SET) == 0; }
+    size_t tell() override { return ftell(file); }
+};
+
+#ifdef __3DS__
+FS_Archive SdmcArchive() {
+    static FS_Archive archive = 0;
+    if (archive == 0) FSUSER_OpenArchive(&archive, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""));
+    return archive;
+}
+
+// The FS service has a high fixed cost per request, so files are read in large blocks aligned to the block size
+class NativeReader : public Reader {
+   private:
+    static constexpr size_t kBufferAlignment = 0x1000;
+
+    Handle file = 0;
+    bool file_open = false;
+    u64 file_size = 0;
+
+    u8 *block;
+    size_t block_size;
+    size_t block_offset = 0;
+    size_t block_length = 0;
+    size_t position = 0;
+
+    bool FillBlock(size_t offset) {
+        u32 bytes_read = 0;
+        block_offset = offset - offset % block_size;
+        block_length = 0;
+        if (R_FAILED(FSFILE_Read(file, &bytes_read, block_offset, block, block_size))) return false;
+
+        block_length = bytes_read;
+        return true;
+    }
+
+   public:
+    explicit NativeReader(size_t block_size) : block_size(block_size) { block = static_cast<u8 *>(memalign(kBufferAlignment, block_size)); }
+
+    ~NativeReader() {
+        close();
+        free(block);
+    }
+
+    bool open(const char *filename) override {
+        close();
+        if (R_FAILED(FSUSER_OpenFile(&file, SdmcArchive(), fsMakePath(PATH_ASCII, filename), FS_OPEN_READ, 0))) return false;
+        if (R_FAILED(FSFILE_GetSize(file, &file_size))) {
+            FSFILE_Close(file);
+            return false;
+        }
+
+        file_open = true;
+        block_offset = 0;
+        block_length = 0;
+        position = 0;
+        return true;
+    }
+
+    void close() override {
+        if (file_open) FSFILE_Close(file);
+        file_open = false;
+    }
+
+    size_t read(void *dst, size_t size) override {
+        u8 *out = static_cast<u8 *>(dst);
+        size_t total = 0;
+
+        while (total < size && position < file_size) {
+            if (position < block_offset || position >= block_offset + block_length) {
+                // Requests of whole aligned blocks skip the intermediate copy
+                size_t remaining = size - total;
+                if (position % block_size == 0 && remaining >= block_size) {
+                    u32 bytes_read = 0;
+                    size_t length = remaining - remaining % block_size;
+                    if (R_FAILED(FSFILE_Read(file, &bytes_read, position, out + total, length)) || bytes_read == 0) break;
+
+                    total += bytes_read;
+                    position += bytes_read;
+                    continue;
+                }
+
+                if (!FillBlock(position) || position >= block_offset + block_length) break;
+            }
+
+            size_t count = std::min(size - total, block_offset + block_length - position);
+            memcpy(out + total, block + (position - block_offset), count);
+            total += count;
+            position += count;
+        }
+
+        return total;
+    }
+
+    bool seek(size_t offset) override {
+        if (!file_open || offset > file_size) return false;
+        position = offset;
+        return true;
+    }
+
+    size_t tell() override { return position; }
+};
+#else
+class MmapReader : public Reader {
+   private:
+    const u8 *data = nullptr;
+    size_t file_size = 0;
+    size_t position = 0;
+
+   public:
+    ~MmapReader() { close(); }
+
+    bool open(const char *filename) override {
+        close();
+
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+
+        file_size = st.st_size;
+        position = 0;
+        if (file_size > 0) {
+            void *mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                ::close(fd);
+                file_size = 0;
+                return false;
+            }
+            data = static_cast<const u8 *>(mapping);
+        }
+
+        ::close(fd);
+        return true;
+    }
+
+    void close() override {
+        if (data) munmap(const_cast<u8 *>(data), file_size);
+        data = nullptr;
+        file_size = 0;
+    }
+
+    size_t read(void *dst, size_t size) override {
+        size_t count = std::min(size, file_size - std::min(position, file_size));
+        if (count > 0) memcpy(dst, data + position, count);
+        position += count;
+        return count;
+    }
+
+    bool seek(size_t offset) override {
+        if (offset > file_size) return false;
+        position = offset;
+        return true;
+    }
+
+    size_t tell() override { return position; }
+};
+#endif
+
+std::unique_ptr<Reader> CreateReader(Backend backend, size_t block_size) {
+    switch (backend) {
+#ifdef __3DS__
+        case kNative:
+            return std::make_unique<NativeReader>(block_size);
+#else
+        case kMmap:
+            return std::make_unique<MmapReader>();
+#endif
+        default:
+            return std::make_unique<StdioReader>(block_size);
+    }
+}
+
+std::unique_ptr<Reader> CreateReader() { return CreateReader(default_backend, default_block_size); }
+
+void SetDefaultBackend(Backend backend, size_t block_size) {
+    default_backend = backend;
+    default_block_size = block_size;
+}
+
+bool ReadFile(const std::string &path, std::string &contents) {
+    auto reader = CreateReader();
+    if (!reader->open(path.c_str())) return false;
+
+    contents.clear();
+    char buffer[4096];
+    while (size_t count = reader->read(buffer, sizeof(buffer))) {
+        contents.append(buffer, count);
+    }
+
+    reader->close();
+    return true;
+}
+
+#ifdef __3DS__
+bool ListFiles(const std::string &path, std::vector<std::string> &names) {
+    Handle dir;
+    if (R_FAILED(FSUSER_OpenDirectory(&dir, SdmcArchive(), fsMakePath(PATH_ASCII, path.c_str())))) return false;
+
+    // Entries are requested in batches, each FSDIR_Read is a round trip to the FS service
+    constexpr u32 kBatchSize = 32;
+    std::vector<FS_DirectoryEntry> entries(kBatchSize);
+    u8 name[sizeof(entries[0].name) * 2];
+
+    u32 entries_read = 0;
+    while (R_SUCCEEDED(FSDIR_Read(dir, &entries_read, kBatchSize, entries.data())) && entries_read > 0) {
+        for (u32 i = 0; i < entries_read; i++) {
+            if (entries[i].attributes & FS_ATTRIBUTE_DIRECTORY) continue;
+
+            ssize_t length = utf16_to_utf8(name, entries[i].name, sizeof(name) - 1);
+            if (length <= 0) continue;
+            names.emplace_back(reinterpret_cast<char *>(name), length);
+        }
+    }
+
+    FSDIR_Close(dir);
+    return true;
+}
+#else
+bool ListFiles(const std::string &path, std::vector<std::string> &names) {
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(path, error)) {
+        if (!entry.is_directory()) names.push_back(entry.path().filename().string());
+    }
+    return !error;
+}
+#endif
+}  // namespace io
@@ -21,6 +21,7 @@ int main(int argc, char **argv) {
         if (ui::PressedExit()) break;
 
         ui::Render();
+        screenshots::EndFrame();
     }
 
     if (tags::WasModified()) tags::Save();
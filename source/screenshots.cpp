@@ -13,11 +13,14 @@
 #include <string>
 #include <vector>
 
+#include "io.hpp"
 #include "loadbmp.hpp"
 #include "settings.hpp"
 #include "tags.hpp"
+#include "threads/decode_pool.hpp"
 #include "threads/screenshot_thread.hpp"
 #include "threads/thumbnail_thread.hpp"
+#include "thumbnail_store.hpp"
 #include "ui.hpp"
 
 namespace screenshots {
@@ -36,33 +39,34 @@ std::vector<mutable_info_ptr> screenshots_shown;
 std::vector<mutable_info_ptr> screenshots_hidden;
 ScreenshotOrder screenshot_order = kTags;
 
+threads::DecodePool *decodePool;
 threads::ScreenshotThread *screenshotThread;
 threads::ThumbnailThread *thumbnailThread;
+ThumbnailStore *thumbnailStore;
+thumbnail_cache_hook thumbnailCacheHook = nullptr;
+// Position of the screenshot loaded last, the neighbours in the direction of the move are loaded first
+size_t last_loaded_index = 0;
 
 void SearchScreenshots() {
-    auto files = std::vector<std::filesystem::path>();
+    auto files = std::vector<std::string>();
 
-    std::filesystem::directory_iterator iter;
-    try {
-        iter = std::filesystem::directory_iterator(settings::ScreenshotsPath());
-    } catch (const std::filesystem::filesystem_error &err) {
-        std::cout << "Failed screenshot search: " << err.what() << '\n';
+    if (!io::ListFiles(settings::ScreenshotsPath(), files)) {
+        std::cout << "Failed screenshot search: " << settings::ScreenshotsPath() << '\n';
         return;
     }
 
-    for (const auto &entry : iter) files.push_back(entry.path());
-
     std::sort(files.begin(), files.end());
 
     for (size_t i = 0; i < files.size(); i++) {
         SCRS_TYPE type;
         std::string name;
 
-        std::string filename = files[i].filename().string();
+        const std::string &filename = files[i];
         for (size_t s = 0; s < sizeof(suffixes) / sizeof(*suffixes); s++) {
             if (filename.ends_with(suffixes[s])) {
                 type = (SCRS_TYPE)s;
                 name = filename.substr(0, filename.size() - suffixes[s].size());
+                std::string path = (std::filesystem::path(settings::ScreenshotsPath()) / filename).string();
 
                 if (screenshots.size() == 0 || screenshots.back()->name != name) {
                     screenshots.push_back(new ScreenshotInfo(name, tags::GetScreenshotTags(name)));
@@ -71,13 +75,13 @@ void SearchScreenshots() {
                 auto scrs = screenshots.back();
                 switch (type) {
                     case TOP:
-                        scrs->path_top = files[i];
+                        scrs->path_top = path;
                         break;
                     case TOP_RIGHT:
-                        scrs->path_top_right = files[i];
+                        scrs->path_top_right = path;
                         break;
                     case BOTTOM:
-                        scrs->path_bottom = files[i];
+                        scrs->path_bottom = path;
                         break;
                 }
 
@@ -99,9 +103,6 @@ void UpdateOrder() {
         }
     }
 
-    if (thumbnailThread) thumbnailThread->Stop();
-    if (screenshotThread) screenshotThread->Stop();
-
     screenshots_shown.clear();
     screenshots_shown.reserve(filtered_screenshots.size());
     switch (screenshot_order) {
@@ -174,29 +175,74 @@ void UpdateOrder() {
             break;
     }
 
-    if (screenshotThread) screenshotThread->Start();
-    if (thumbnailThread) thumbnailThread->Start(screenshots_shown.begin(), screenshots_shown.end());
+    // The thumbnail thread keeps running and its cache, only the thumbnails of screenshots not in it are loaded
+    if (thumbnailThread) thumbnailThread->SetScreenshots(screenshots_shown);
+}
+
+// Called from the screenshot thread
+void TopImageLoaded(info_ptr info, C2D_Image top) {
+    if (thumbnailThread) thumbnailThread->AddFromImage(info, top);
+}
+
+void OpenThumbnailStore() {
+    thumbnailStore = new ThumbnailStore(settings::ThumbnailCachePath(), ui::kThumbnailWidth, ui::kThumbnailHeight, TextureColor(settings::GetThumbnailFormat()),
+                                        settings::SmoothThumbnails());
+
+    std::set<std::string> names;
+    for (auto &screenshot : screenshots) names.insert(screenshot->name);
+    thumbnailStore->Retain(names);
 }
 
 void Init() {
     SearchScreenshots();
     UpdateOrder();
+    OpenThumbnailStore();
 
-    screenshotThread = new threads::ScreenshotThread();
-    thumbnailThread = new threads::ThumbnailThread(screenshots_shown.begin(), screenshots_shown.end());
+    decodePool = new threads::DecodePool();
+    screenshotThread = new threads::ScreenshotThread(*decodePool, settings::ScreenshotBuffers(), TopImageLoaded);
+    thumbnailThread = new threads::ThumbnailThread(*thumbnailStore, *decodePool, thumbnailCacheHook, screenshots_shown);
 }
 
 void Exit() {
     delete screenshotThread;
     delete thumbnailThread;
+    delete thumbnailStore;
+    delete decodePool;
+    screenshotThread = nullptr;
+    thumbnailThread = nullptr;
+    thumbnailStore = nullptr;
+    decodePool = nullptr;
 
     for (auto &screenshot : screenshots) {
         delete screenshot;
     }
+    screenshots.clear();
+    screenshots_shown.clear();
+    screenshots_hidden.clear();
 }
 
 void Load(info_ptr info, void (*callback)(screenshot_ptr)) {
-    if (screenshotThread) screenshotThread->Load(info, callback);
+    if (!screenshotThread) return;
+
+    // The screenshots around it in the order shown, closest first, the ones in the direction of the last move first
+    std::vector<info_ptr> neighbours;
+    auto shown = std::find(screenshots_shown.begin(), screenshots_shown.end(), info);
+    if (shown != screenshots_shown.end()) {
+        size_t index = shown - screenshots_shown.begin();
+        int direction = index < last_loaded_index ? -1 : 1;
+        last_loaded_index = index;
+
+        size_t wanted = screenshotThread->NumNeighbours();
+        for (size_t distance = 1; neighbours.size() < wanted && (distance <= index || index + distance < Count()); distance++) {
+            for (int side : {direction, -direction}) {
+                if (neighbours.size() == wanted) break;
+                if (side > 0 && index + distance < Count()) neighbours.push_back(screenshots_shown[index + distance]);
+                if (side < 0 && distance <= index) neighbours.push_back(screenshots_shown[index - distance]);
+            }
+        }
+    }
+
+    screenshotThread->Load(info, callback, std::move(neighbours));
 }
 
 size_t Count() { return screenshots_shown.size(); }
@@ -204,12 +250,31 @@ size_t NumLoadedThumbnails() {
     if (thumbnailThread) return thumbnailThread->NumLoadedThumbnails();
     return 0;
 }
+size_t NumMissedScreenshots() {
+    if (screenshotThread) return screenshotThread->NumMissedScreenshots();
+    return 0;
+}
+const C2D_Image *GetThumbnail(info_ptr info) {
+    if (thumbnailThread) return thumbnailThread->Acquire(info->thumbnail.load(std::memory_order_acquire));
+    return nullptr;
+}
+bool HasThumbnail(info_ptr info) { return info->thumbnail.load(std::memory_order_acquire) != kNoThumbnail; }
+void EndFrame() {
+    if (thumbnailThread) thumbnailThread->EndFrame();
+}
+void SetThumbnailCacheHook(thumbnail_cache_hook hook) {
+    thumbnailCacheHook = hook;
+    if (thumbnailThread) thumbnailThread->SetCacheHook(hook);
+}
+void SetScroll(size_t page, float pages_per_second) {
+    if (thumbnailThread) thumbnailThread->SetScroll(page, pages_per_second);
+}
 bool FoundScreenshots() { return screenshots.size() > 0; }
 
 info_ptr GetInfo(std::size_t index) {
     if (index >= screenshots_shown.size()) return nullptr;
 
-    if (thumbnailThread) thumbnailThread->SetCurrent(screenshots_shown.begin() + index);
+    if (thumbnailThread) thumbnailThread->SetCurrent(index);
 
     return screenshots_shown[index];
 }
@@ -231,8 +296,9 @@ void Delete(std::set<std::string> screenshot_names) {
         }
     }
 
-    if (thumbnailThread) thumbnailThread->Stop();
+    // The screenshot thread first, it hands thumbnails to the thumbnail thread
     if (screenshotThread) screenshotThread->Stop();
+    if (thumbnailThread) thumbnailThread->Stop();
 
     screenshots = std::move(new_screenshots);
 
@@ -248,6 +314,37 @@ void Delete(std::set<std::string> screenshot_names) {
 
     tags::RemoveScreenshotsTags(screenshot_names);
     UpdateOrder();
+
+    if (screenshotThread) screenshotThread->Start();
+    if (thumbnailThread) thumbnailThread->Start();
+}
+
+float ScrollTracker::Update(size_t page, u64 tick) {
+    if (num_changes == 0 || page != changes[(num_changes - 1) % kSamples].page) {
+        // Turning back starts over
+        if (num_changes >= 2) {
+            const PageChange &last = changes[(num_changes - 1) % kSamples];
+            const PageChange &before = changes[(num_changes - 2) % kSamples];
+            if ((page > last.page) != (last.page > before.page)) {
+                changes[0] = last;
+                num_changes = 1;
+            }
+        }
+        changes[num_changes++ % kSamples] = {page, tick};
+    }
+    if (num_changes < 2) return 0;
+
+    const PageChange &first = changes[num_changes > kSamples ? num_changes % kSamples : 0];
+    const PageChange &last = changes[(num_changes - 1) % kSamples];
+    float pages = static_cast<float>(last.page) - static_cast<float>(first.page);
+    float speed = pages * SYSCLOCK_ARM11 / std::max<u64>(1, last.tick - first.tick);
+
+    // At most a page since the last change, so the speed drops once the scroll stops
+    if (tick > last.tick) {
+        float max_speed = static_cast<float>(SYSCLOCK_ARM11) / (tick - last.tick);
+        speed = std::clamp(speed, -max_speed, max_speed);
+    }
+    return speed;
 }
 
 bool ScreenshotInfo::has_any_tag(std::set<tags::tag_ptr> tags) {
@@ -264,7 +361,7 @@ bool ScreenshotInfo::has_all_tag(std::set<tags::tag_ptr> tags) {
     return true;
 }
 
-ScreenshotInfo::ScreenshotInfo(std::string name, const std::vector<tags::tag_ptr> &tags) : name(name), tags(tags), has_thumbnail(false) {}
+ScreenshotInfo::ScreenshotInfo(std::string name, const std::vector<tags::tag_ptr> &tags) : name(name), tags(tags) {}
 
 Screenshot::~Screenshot() {
     if (top.tex) {
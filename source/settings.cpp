@@ -1,5 +1,6 @@
 #include "settings.hpp"
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
@@ -11,6 +12,7 @@
 #define TOML_ENABLE_FORMATTERS 0
 #include <toml++/toml.hpp>
 
+#include "io.hpp"
 #include "screenshots.hpp"
 
 namespace settings {
@@ -20,9 +22,15 @@ const std::string setings_path = app_folder_path + "settings.toml";
 const std::string tags_path = app_folder_path + "tags.toml";
 
 std::string screenshots_path = "/luma/screenshots";
+std::string thumbnail_cache_path = app_folder_path + "thumbnails";
 
 int extra_stereo_offset = 7;
 bool show_console = false;
+bool smooth_thumbnails = true;
+screenshots::ThumbnailFormat thumbnail_format = screenshots::kThumbnailRGB8;
+int screenshot_buffers = 3;
+constexpr int kMinScreenshotBuffers = 2;
+constexpr int kMaxScreenshotBuffers = 8;
 
 void Save() {
     std::ofstream f(setings_path);
@@ -30,7 +38,13 @@ void Save() {
       << "# 0 - Tags, 1 - Tags (newer first), 2 - Older, 3 - Newer\n"
       << "screenshot_order = " << screenshots::GetOrder() << "\n"
       << "extra_stereo_offset = " << extra_stereo_offset << "\n"
-      << "show_console = " << (show_console ? "true" : "false") << "\n";
+      << "show_console = " << (show_console ? "true" : "false") << "\n"
+      << "# Average pixels when downscaling thumbnails instead of picking the nearest one\n"
+      << "smooth_thumbnails = " << (smooth_thumbnails ? "true" : "false") << "\n"
+      << "# 0 - RGB8, 1 - RGB565 (1.5x the thumbnails in memory), 2 - ETC1 (6x the thumbnails, lower quality)\n"
+      << "thumbnail_format = " << thumbnail_format << "\n"
+      << "# Screenshots kept loaded, the one shown and the ones around it, 2 to 8 (about 1.1 MB of memory each)\n"
+      << "screenshot_buffers = " << screenshot_buffers << "\n";
     f.close();
 }
 
@@ -39,15 +53,24 @@ void Load() {
         std::filesystem::create_directories(app_folder_path);
     }
 
-    if (std::filesystem::exists(setings_path)) {
-        toml::parse_result result = toml::parse_file(setings_path);
+    std::string contents;
+    if (io::ReadFile(setings_path, contents)) {
+        toml::parse_result result = toml::parse(contents, setings_path);
         if (!result) return;
 
         toml::table data = std::move(result).table();
 
         screenshots_path = data["screenshots_path"].value_or(screenshots_path);
         show_console = data["show_console"].value_or(show_console);
+        smooth_thumbnails = data["smooth_thumbnails"].value_or(smooth_thumbnails);
         extra_stereo_offset = data["extra_stereo_offset"].value_or(extra_stereo_offset);
+        SetScreenshotBuffers(data["screenshot_buffers"].value_or(screenshot_buffers));
+
+        if (auto format = data["thumbnail_format"].as_integer()) {
+            if (format->get() >= screenshots::kFirstThumbnailFormat && format->get() <= screenshots::kLastThumbnailFormat) {
+                thumbnail_format = static_cast<screenshots::ThumbnailFormat>(format->get());
+            }
+        }
 
         if (auto order = data["screenshot_order"].as_integer()) {
             screenshots::SetOrder(static_cast<screenshots::ScreenshotOrder>(order->get()));
@@ -59,8 +82,15 @@ void Load() {
 }
 
 const std::string ScreenshotsPath() { return screenshots_path; }
+void SetScreenshotsPath(std::string path) { screenshots_path = path; }
 const std::string TagsPath() { return tags_path; }
+const std::string ThumbnailCachePath() { return thumbnail_cache_path; }
+void SetThumbnailCachePath(std::string path) { thumbnail_cache_path = path; }
 const bool ShowConsole() { return show_console; }
+const bool SmoothThumbnails() { return smooth_thumbnails; }
+const screenshots::ThumbnailFormat GetThumbnailFormat() { return thumbnail_format; }
+const int ScreenshotBuffers() { return screenshot_buffers; }
+void SetScreenshotBuffers(int buffers) { screenshot_buffers = std::clamp(buffers, kMinScreenshotBuffers, kMaxScreenshotBuffers); }
 
 const int GetExtraStereoOffset() { return extra_stereo_offset; }
 void SetExtraStereoOffset(int offset) { extra_stereo_offset = offset; }
@@ -11,6 +11,7 @@
 #define TOML_ENABLE_FORMATTERS 0
 #include <toml++/toml.hpp>
 
+#include "io.hpp"
 #include "screenshots.hpp"
 #include "settings.hpp"
 
@@ -95,8 +96,9 @@ void Load() {
     screenshot_tags.clear();
 
     const std::string tags_path = settings::TagsPath();
-    if (std::filesystem::exists(tags_path)) {
-        toml::parse_result result = toml::parse_file(tags_path);
+    std::string contents;
+    if (io::ReadFile(tags_path, contents)) {
+        toml::parse_result result = toml::parse(contents, tags_path);
         if (!result) {
             std::cerr << "Parsing failed:\n" << result.error() << "\n";
             return;
@@ -0,0 +1,66 @@
+#include "thumbnail_atlas.hpp"
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <citro3d.h>
+#include <string.h>
+
+#include <vector>
+
+#include "thumbnail_format.hpp"
+
+namespace screenshots {
+
+ThumbnailAtlas::ThumbnailAtlas(u16 width, u16 height, size_t num_cells, GPU_TEXCOLOR color)
+    : width(width), height(height), color(color), columns(kPageWidth / ((width + 7) & ~7)), cells_per_page(CellsPerPage(width, height)) {
+    // Reserved so the subtextures handed out never move
+    subtextures.resize(num_cells);
+    pages.reserve((num_cells + cells_per_page - 1) / cells_per_page);
+}
+
+ThumbnailAtlas::~ThumbnailAtlas() {
+    for (auto page : pages) {
+        C3D_TexDelete(page);
+        delete page;
+    }
+}
+
+size_t ThumbnailAtlas::PageSize(GPU_TEXCOLOR color) { return (kPageWidth / 8) * (kPageHeight / 8) * TileSize(color); }
+
+C2D_Image ThumbnailAtlas::Image(size_t cell) {
+    size_t page = cell / cells_per_page;
+    while (pages.size() <= page) {
+        C3D_Tex *tex = new C3D_Tex;
+        if (!C3D_TexInit(tex, kPageWidth, kPageHeight, color)) {
+            delete tex;
+            return C2D_Image({nullptr, nullptr});
+        }
+        tex->border = 0xFFFFFFFF;
+        C3D_TexSetWrap(tex, GPU_CLAMP_TO_BORDER, GPU_CLAMP_TO_BORDER);
+        memset(tex->data, 0, tex->size);
+        pages.push_back(tex);
+    }
+
+    u32 index = cell % cells_per_page;
+    u32 x = (index % columns) * ((width + 7) & ~7);
+    u32 y = (index / columns) * ((height + 7) & ~7);
+
+    Tex3DS_SubTexture *subtex = &subtextures[cell];
+    subtex->width = width;
+    subtex->height = height;
+    subtex->left = x / static_cast<float>(kPageWidth);
+    subtex->right = (x + width) / static_cast<float>(kPageWidth);
+    subtex->top = 1.0f - y / static_cast<float>(kPageHeight);
+    subtex->bottom = 1.0f - (y + height) / static_cast<float>(kPageHeight);
+
+    return C2D_Image({pages[page], subtex});
+}
+
+void ThumbnailAtlas::ReleaseLastPage() {
+    if (pages.empty()) return;
+
+    C3D_TexDelete(pages.back());
+    delete pages.back();
+    pages.pop_back();
+}
+}  // namespace screenshots
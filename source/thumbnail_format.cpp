@@ -0,0 +1,319 @@
+#include "thumbnail_format.hpp"
+
+#include <3ds.h>
+#include <citro2d.h>
+#include <citro3d.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "loadbmp.hpp"
+
+namespace screenshots {
+
+namespace {
+
+constexpr u32 kTexelSize = LOADBMP_RGB;
+
+// RGB8 texels are stored blue first
+struct Color {
+    s32 r, g, b;
+};
+
+Color LoadTexel(const u8 *tile, u32 x, u32 y) {
+    const u8 *texel = tile + kTileOffsets[y * 8 + x] * kTexelSize;
+    return {texel[2], texel[1], texel[0]};
+}
+
+void StoreTexel(u8 *tile, u32 x, u32 y, Color color) {
+    u8 *texel = tile + kTileOffsets[y * 8 + x] * kTexelSize;
+    texel[0] = color.b;
+    texel[1] = color.g;
+    texel[2] = color.r;
+}
+
+// Scales a channel to bits bits, rounding to nearest
+constexpr u32 Quantize(s32 value, u32 bits) { return (value * ((1 << bits) - 1) + 127) / 255; }
+
+// Scales a channel of bits bits back to 8 by repeating its high bits
+constexpr s32 Expand(u32 value, u32 bits) { return (value << (8 - bits)) | (value >> (2 * bits - 8)); }
+
+void EncodeRGB565(const u8 *rgb8, u8 *dst) {
+    for (u32 i = 0; i < 64; i++, rgb8 += kTexelSize, dst += 2) {
+        u16 texel = (Quantize(rgb8[2], 5) << 11) | (Quantize(rgb8[1], 6) << 5) | Quantize(rgb8[0], 5);
+        dst[0] = texel;
+        dst[1] = texel >> 8;
+    }
+}
+
+void DecodeRGB565(const u8 *src, u8 *rgb8) {
+    for (u32 i = 0; i < 64; i++, src += 2, rgb8 += kTexelSize) {
+        u16 texel = src[0] | (src[1] << 8);
+        rgb8[0] = Expand(texel & 0x1F, 5);
+        rgb8[1] = Expand((texel >> 5) & 0x3F, 6);
+        rgb8[2] = Expand(texel >> 11, 5);
+    }
+}
+
+// ETC1: every 4x4 block is two 2x4 or 4x2 halves (the flip bit picks which), each with a base color and a table of
+// intensity modifiers, and a 2 bit modifier index per pixel. Bases are either two 4 bit colors or a 5 bit color and a
+// 3 bit signed difference to it. The PICA200 stores each 64 bit block little endian, and the four blocks of an 8x8 tile
+// in Z order.
+constexpr s32 kEtc1Modifiers[8][2] = {{2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}};
+
+// Modifier of each 2 bit pixel index (msb << 1 | lsb)
+constexpr s32 Etc1Modifier(u32 table, u32 index) {
+    s32 modifier = kEtc1Modifiers[table][index & 1];
+    return index & 2 ? -modifier : modifier;
+}
+
+constexpr s32 Clamp(s32 value) { return std::clamp(value, 0, 255); }
+
+struct Etc1Block {
+    Color pixels[4][4];  // [y][x]
+
+    // Pixels of half 0 or 1 of the block, the left and right halves when not flipped, top and bottom when flipped
+    static bool InHalf(u32 x, u32 y, bool flip, u32 half) { return (flip ? y : x) / 2 == half; }
+};
+
+// Picks the table and pixel indices of a block half for its base color, returns the squared error
+u32 FitHalf(const Etc1Block &block, bool flip, u32 half, Color base, u32 &table, u64 &indices) {
+    u32 best_error = UINT32_MAX;
+    for (u32 t = 0; t < 8 && best_error > 0; t++) {
+        Color candidates[4];
+        for (u32 index = 0; index < 4; index++) {
+            s32 modifier = Etc1Modifier(t, index);
+            candidates[index] = {Clamp(base.r + modifier), Clamp(base.g + modifier), Clamp(base.b + modifier)};
+        }
+
+        u32 error = 0;
+        u64 table_indices = 0;
+        for (u32 y = 0; y < 4 && error < best_error; y++) {
+            for (u32 x = 0; x < 4; x++) {
+                if (!Etc1Block::InHalf(x, y, flip, half)) continue;
+
+                const Color &pixel = block.pixels[y][x];
+                u32 best_pixel_error = UINT32_MAX;
+                u32 best_index = 0;
+                for (u32 index = 0; index < 4; index++) {
+                    s32 dr = candidates[index].r - pixel.r;
+                    s32 dg = candidates[index].g - pixel.g;
+                    s32 db = candidates[index].b - pixel.b;
+                    u32 pixel_error = dr * dr + dg * dg + db * db;
+                    if (pixel_error < best_pixel_error) {
+                        best_pixel_error = pixel_error;
+                        best_index = index;
+                    }
+                }
+
+                error += best_pixel_error;
+                u32 bit = x * 4 + y;
+                table_indices |= (static_cast<u64>(best_index >> 1) << (bit + 16)) | (static_cast<u64>(best_index & 1) << bit);
+            }
+        }
+
+        if (error < best_error) {
+            best_error = error;
+            table = t;
+            indices = table_indices;
+        }
+    }
+    return best_error;
+}
+
+// Tries both halvings of the block in both base color modes, keeps the closest encoding
+u64 EncodeEtc1Block(const Etc1Block &block) {
+    u64 best_bits = 0;
+    u32 best_error = UINT32_MAX;
+
+    for (u32 flip = 0; flip < 2; flip++) {
+        Color averages[2] = {};
+        for (u32 y = 0; y < 4; y++) {
+            for (u32 x = 0; x < 4; x++) {
+                Color &average = averages[Etc1Block::InHalf(x, y, flip, 1)];
+                average.r += block.pixels[y][x].r;
+                average.g += block.pixels[y][x].g;
+                average.b += block.pixels[y][x].b;
+            }
+        }
+        for (auto &average : averages) average = {(average.r + 4) / 8, (average.g + 4) / 8, (average.b + 4) / 8};
+
+        for (u32 differential = 0; differential < 2; differential++) {
+            u32 bits = differential ? 5 : 4;
+            u32 quantized[2][3];
+            for (u32 half = 0; half < 2; half++) {
+                quantized[half][0] = Quantize(averages[half].r, bits);
+                quantized[half][1] = Quantize(averages[half].g, bits);
+                quantized[half][2] = Quantize(averages[half].b, bits);
+            }
+
+            s32 deltas[3];
+            if (differential) {
+                bool fits = true;
+                for (u32 c = 0; c < 3; c++) {
+                    deltas[c] = static_cast<s32>(quantized[1][c]) - static_cast<s32>(quantized[0][c]);
+                    fits = fits && deltas[c] >= -4 && deltas[c] <= 3;
+                }
+                if (!fits) continue;
+            }
+
+            u32 tables[2];
+            u64 indices[2];
+            u32 error = 0;
+            for (u32 half = 0; half < 2; half++) {
+                Color base = {Expand(quantized[half][0], bits), Expand(quantized[half][1], bits), Expand(quantized[half][2], bits)};
+                error += FitHalf(block, flip, half, base, tables[half], indices[half]);
+            }
+            if (error >= best_error) continue;
+
+            u64 block_bits;
+            if (differential) {
+                block_bits = (static_cast<u64>(quantized[0][0]) << 59) | (static_cast<u64>(deltas[0] & 7) << 56) | (static_cast<u64>(quantized[0][1]) << 51) |
+                             (static_cast<u64>(deltas[1] & 7) << 48) | (static_cast<u64>(quantized[0][2]) << 43) | (static_cast<u64>(deltas[2] & 7) << 40);
+            } else {
+                block_bits = (static_cast<u64>(quantized[0][0]) << 60) | (static_cast<u64>(quantized[1][0]) << 56) | (static_cast<u64>(quantized[0][1]) << 52) |
+                             (static_cast<u64>(quantized[1][1]) << 48) | (static_cast<u64>(quantized[0][2]) << 44) | (static_cast<u64>(quantized[1][2]) << 40);
+            }
+            block_bits |= (static_cast<u64>(tables[0]) << 37) | (static_cast<u64>(tables[1]) << 34) | (static_cast<u64>(differential) << 33) |
+                          (static_cast<u64>(flip) << 32) | indices[0] | indices[1];
+
+            best_error = error;
+            best_bits = block_bits;
+        }
+    }
+
+    return best_bits;
+}
+
+void DecodeEtc1Block(u64 bits, Etc1Block &block) {
+    bool flip = (bits >> 32) & 1;
+    bool differential = (bits >> 33) & 1;
+    u32 tables[2] = {static_cast<u32>(bits >> 37) & 7, static_cast<u32>(bits >> 34) & 7};
+
+    Color bases[2];
+    if (differential) {
+        s32 first[3], second[3];
+        for (u32 c = 0; c < 3; c++) {
+            first[c] = (bits >> (59 - c * 8)) & 0x1F;
+            s32 delta = (bits >> (56 - c * 8)) & 7;
+            second[c] = first[c] + (delta >= 4 ? delta - 8 : delta);
+        }
+        bases[0] = {Expand(first[0], 5), Expand(first[1], 5), Expand(first[2], 5)};
+        bases[1] = {Expand(second[0], 5), Expand(second[1], 5), Expand(second[2], 5)};
+    } else {
+        for (u32 half = 0; half < 2; half++) {
+            u32 shift = half ? 56 : 60;
+            bases[half] = {Expand((bits >> shift) & 0xF, 4), Expand((bits >> (shift - 8)) & 0xF, 4), Expand((bits >> (shift - 16)) & 0xF, 4)};
+        }
+    }
+
+    for (u32 y = 0; y < 4; y++) {
+        for (u32 x = 0; x < 4; x++) {
+            u32 half = Etc1Block::InHalf(x, y, flip, 1);
+            u32 bit = x * 4 + y;
+            u32 index = (((bits >> (bit + 16)) & 1) << 1) | ((bits >> bit) & 1);
+            s32 modifier = Etc1Modifier(tables[half], index);
+            block.pixels[y][x] = {Clamp(bases[half].r + modifier), Clamp(bases[half].g + modifier), Clamp(bases[half].b + modifier)};
+        }
+    }
+}
+
+void EncodeETC1(const u8 *rgb8, u8 *dst) {
+    for (u32 by = 0; by < 2; by++) {
+        for (u32 bx = 0; bx < 2; bx++, dst += sizeof(u64)) {
+            Etc1Block block;
+            for (u32 y = 0; y < 4; y++) {
+                for (u32 x = 0; x < 4; x++) block.pixels[y][x] = LoadTexel(rgb8, bx * 4 + x, by * 4 + y);
+            }
+
+            u64 bits = EncodeEtc1Block(block);
+            for (u32 i = 0; i < sizeof(u64); i++) dst[i] = bits >> (i * 8);
+        }
+    }
+}
+
+void DecodeETC1(const u8 *src, u8 *rgb8) {
+    for (u32 by = 0; by < 2; by++) {
+        for (u32 bx = 0; bx < 2; bx++, src += sizeof(u64)) {
+            u64 bits = 0;
+            for (u32 i = 0; i < sizeof(u64); i++) bits |= static_cast<u64>(src[i]) << (i * 8);
+
+            Etc1Block block;
+            DecodeEtc1Block(bits, block);
+            for (u32 y = 0; y < 4; y++) {
+                for (u32 x = 0; x < 4; x++) StoreTexel(rgb8, bx * 4 + x, by * 4 + y, block.pixels[y][x]);
+            }
+        }
+    }
+}
+
+// Calls fn(rgb8 tile, img tile) for every tile covered by the subtextures of the two images
+template <typename Fn>
+void ForEachTile(C2D_Image rgb8, C2D_Image img, Fn fn) {
+    bmp_target rgb8_target = loadbmp_target(rgb8);
+    bmp_target img_target = loadbmp_target(img);
+    u32 rgb8_tile_size = TileSize(GPU_RGB8);
+    u32 img_tile_size = TileSize(img.tex->fmt);
+
+    for (u32 tile_row = 0; tile_row < img_target.height / 8; tile_row++) {
+        u8 *rgb8_tile = rgb8_target.data + tile_row * rgb8_target.tile_row_stride;
+        u8 *img_tile = img_target.data + tile_row * img_target.tile_row_stride;
+        for (u32 tile = 0; tile < img_target.width / 8; tile++, rgb8_tile += rgb8_tile_size, img_tile += img_tile_size) fn(rgb8_tile, img_tile);
+    }
+}
+}  // namespace
+
+GPU_TEXCOLOR TextureColor(ThumbnailFormat format) {
+    switch (format) {
+        case kThumbnailRGB565:
+            return GPU_RGB565;
+        case kThumbnailETC1:
+            return GPU_ETC1;
+        case kThumbnailRGB8:
+        default:
+            return GPU_RGB8;
+    }
+}
+
+u32 TileSize(GPU_TEXCOLOR color) {
+    switch (color) {
+        case GPU_RGB565:
+            return 64 * 2;
+        case GPU_ETC1:
+            return 4 * sizeof(u64);
+        case GPU_RGB8:
+        default:
+            return 64 * kTexelSize;
+    }
+}
+
+void EncodeImage(C2D_Image rgb8, C2D_Image img) {
+    switch (img.tex->fmt) {
+        case GPU_RGB565:
+            ForEachTile(rgb8, img, EncodeRGB565);
+            break;
+        case GPU_ETC1:
+            ForEachTile(rgb8, img, EncodeETC1);
+            break;
+        default:
+            ForEachTile(rgb8, img, [](const u8 *src, u8 *dst) { memcpy(dst, src, 64 * kTexelSize); });
+            break;
+    }
+
+    C3D_TexFlush(img.tex);
+}
+
+void DecodeImage(C2D_Image img, C2D_Image rgb8) {
+    switch (img.tex->fmt) {
+        case GPU_RGB565:
+            ForEachTile(rgb8, img, [](u8 *dst, const u8 *src) { DecodeRGB565(src, dst); });
+            break;
+        case GPU_ETC1:
+            ForEachTile(rgb8, img, [](u8 *dst, const u8 *src) { DecodeETC1(src, dst); });
+            break;
+        default:
+            ForEachTile(rgb8, img, [](u8 *dst, const u8 *src) { memcpy(dst, src, 64 * kTexelSize); });
+            break;
+    }
+}
+}  // namespace screenshots
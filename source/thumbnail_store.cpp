@@ -0,0 +1,326 @@
+#include "thumbnail_store.hpp"
+
+#include <3ds.h>
+#include <citro3d.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "loadbmp.hpp"
+#include "thumbnail_format.hpp"
+
+namespace screenshots {
+
+namespace {
+constexpr char kDataMagic[4] = {'S', 'V', 'T', 'D'};
+constexpr char kIndexMagic[4] = {'S', 'V', 'T', 'I'};
+constexpr u32 kVersion = 2;
+
+// Names longer than this are not stored
+constexpr size_t kMaxNameLength = 63;
+
+// The index is also written every so many new thumbnails, so a crash loses little work
+constexpr size_t kSavesPerFlush = 64;
+
+struct DataHeader {
+    char magic[4];
+    u32 version;
+    u32 variant;
+    u32 slot_size;
+    u16 width;
+    u16 height;
+    u32 format;
+};
+
+struct IndexHeader {
+    char magic[4];
+    u32 version;
+    u32 count;
+};
+
+struct IndexEntry {
+    char name[kMaxNameLength + 1];
+    u64 size;
+    u64 mtime;
+    u32 slot;
+    u32 reserved;
+};
+
+static_assert(sizeof(IndexEntry) == 88, "Index entries are stored as is");
+}  // namespace
+
+ThumbnailStore::ThumbnailStore(const std::string &path, u16 width, u16 height, GPU_TEXCOLOR color, u32 variant)
+    : index_path(path + ".idx"),
+      data_path(path + ".bin"),
+      variant(variant),
+      slot_size(((width + 7) / 8) * ((height + 7) / 8) * TileSize(color)),
+      width(width),
+      height(height),
+      format(color),
+      buffer(slot_size) {
+    data = fopen(data_path.c_str(), "r+b");
+
+    DataHeader header;
+    bool valid = data && fread(&header, sizeof(header), 1, data) == 1 && memcmp(header.magic, kDataMagic, sizeof(kDataMagic)) == 0 &&
+                 header.version == kVersion && header.variant == variant && header.slot_size == slot_size && header.width == width &&
+                 header.height == height && header.format == this->format;
+
+    if (!valid || !LoadIndex()) Reset();
+}
+
+ThumbnailStore::~ThumbnailStore() {
+    Flush();
+    if (data) fclose(data);
+}
+
+void ThumbnailStore::Reset() {
+    entries.clear();
+    slot_names.clear();
+    free_slots.clear();
+
+    if (data) fclose(data);
+    data = fopen(data_path.c_str(), "w+b");
+    if (!data) {
+        std::cout << "Failed to create the thumbnail store " << data_path << '\n';
+        return;
+    }
+
+    DataHeader header;
+    memcpy(header.magic, kDataMagic, sizeof(kDataMagic));
+    header.version = kVersion;
+    header.variant = variant;
+    header.slot_size = slot_size;
+    header.width = width;
+    header.height = height;
+    header.format = format;
+    fwrite(&header, sizeof(header), 1, data);
+
+    index_dirty = true;
+    Flush();
+}
+
+bool ThumbnailStore::LoadIndex() {
+    FILE *index = fopen(index_path.c_str(), "rb");
+    if (!index) return false;
+
+    IndexHeader header;
+    bool valid = fread(&header, sizeof(header), 1, index) == 1 && memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) == 0 && header.version == kVersion;
+
+    // The count must match the size of the index, a corrupt one would have the entries allocated take any size
+    long index_size = valid && fseek(index, 0, SEEK_END) == 0 ? ftell(index) : -1;
+    valid = valid && index_size >= static_cast<long>(sizeof(header)) && header.count == (index_size - sizeof(header)) / sizeof(IndexEntry);
+    valid = valid && fseek(index, sizeof(header), SEEK_SET) == 0;
+
+    // Slots past the end of the data file were written after the index and lost
+    fseek(data, 0, SEEK_END);
+    long data_size = ftell(data);
+    u32 num_slots = data_size > SlotOffset(0) ? (data_size - SlotOffset(0)) / slot_size : 0;
+
+    std::vector<IndexEntry> index_entries(valid ? header.count : 0);
+    valid = valid && fread(index_entries.data(), sizeof(IndexEntry), index_entries.size(), index) == index_entries.size();
+    fclose(index);
+    if (!valid) return false;
+
+    slot_names.assign(num_slots, "");
+    for (auto &entry : index_entries) {
+        entry.name[kMaxNameLength] = '\0';
+        if (entry.slot >= num_slots || !slot_names[entry.slot].empty()) continue;
+
+        entries[entry.name] = Entry{{entry.size, entry.mtime}, entry.slot};
+        slot_names[entry.slot] = entry.name;
+    }
+
+    for (u32 slot = 0; slot < num_slots; slot++) {
+        if (slot_names[slot].empty()) free_slots.insert(slot);
+    }
+    TrimFreeSlots();
+
+    return true;
+}
+
+long ThumbnailStore::SlotOffset(u32 slot) { return sizeof(DataHeader) + static_cast<long>(slot) * slot_size; }
+
+bool ThumbnailStore::MatchesTarget(C2D_Image img) { return img.tex->fmt == format && img.subtex->width == width && img.subtex->height == height; }
+
+bool ThumbnailStore::Contains(const std::string &name, const std::string &path, FileKey &key) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        key = FileKey();
+        return false;
+    }
+    key = FileKey{static_cast<u64>(st.st_size), static_cast<u64>(st.st_mtime)};
+
+    auto entry = entries.find(name);
+    if (!data || entry == entries.end()) return false;
+
+    if (entry->second.key.size != key.size || entry->second.key.mtime != key.mtime) {
+        Drop(name);
+        return false;
+    }
+    return true;
+}
+
+bool ThumbnailStore::Load(const std::string &name, const std::string &path, C2D_Image img, FileKey &key) {
+    if (!Contains(name, path, key) || !MatchesTarget(img)) return false;
+
+    auto entry = entries.find(name);
+    if (fseek(data, SlotOffset(entry->second.slot), SEEK_SET) != 0 || fread(buffer.data(), slot_size, 1, data) != 1) {
+        Drop(name);
+        return false;
+    }
+
+    bmp_target target = loadbmp_target(img);
+    for (u32 tile_row = 0; tile_row < target.height / 8; tile_row++) {
+        memcpy(target.data + tile_row * target.tile_row_stride, buffer.data() + tile_row * target.row_size, target.row_size);
+    }
+
+    C3D_TexFlush(img.tex);
+    return true;
+}
+
+void ThumbnailStore::Save(const std::string &name, const FileKey &key, C2D_Image img) {
+    if (!data || name.size() > kMaxNameLength || !MatchesTarget(img)) return;
+
+    bmp_target target = loadbmp_target(img);
+    for (u32 tile_row = 0; tile_row < target.height / 8; tile_row++) {
+        memcpy(buffer.data() + tile_row * target.row_size, target.data + tile_row * target.tile_row_stride, target.row_size);
+    }
+
+    Drop(name);
+
+    u32 slot = slot_names.size();
+    if (!free_slots.empty()) {
+        slot = *free_slots.begin();
+        free_slots.erase(free_slots.begin());
+    } else {
+        slot_names.emplace_back();
+    }
+
+    if (fseek(data, SlotOffset(slot), SEEK_SET) != 0 || fwrite(buffer.data(), slot_size, 1, data) != 1) {
+        free_slots.insert(slot);
+        TrimFreeSlots();
+        return;
+    }
+
+    entries[name] = Entry{key, slot};
+    slot_names[slot] = name;
+    index_dirty = true;
+
+    if (++saves_since_flush >= kSavesPerFlush) Flush();
+}
+
+void ThumbnailStore::Drop(const std::string &name) {
+    auto entry = entries.find(name);
+    if (entry == entries.end()) return;
+
+    slot_names[entry->second.slot].clear();
+    free_slots.insert(entry->second.slot);
+    entries.erase(entry);
+    index_dirty = true;
+
+    TrimFreeSlots();
+}
+
+// Holes at the end of the data file are removed right away
+void ThumbnailStore::TrimFreeSlots() {
+    u32 num_slots = slot_names.size();
+    while (!free_slots.empty() && *free_slots.rbegin() == slot_names.size() - 1) {
+        free_slots.erase(std::prev(free_slots.end()));
+        slot_names.pop_back();
+    }
+
+    if (data && num_slots != slot_names.size()) {
+        fflush(data);
+        ftruncate(fileno(data), SlotOffset(slot_names.size()));
+    }
+}
+
+void ThumbnailStore::Retain(const std::set<std::string> &names) {
+    std::vector<std::string> stale;
+    for (const auto &[name, entry] : entries) {
+        if (!names.contains(name)) stale.push_back(name);
+    }
+
+    for (const auto &name : stale) Drop(name);
+}
+
+bool ThumbnailStore::Compact() {
+    if (!data || free_slots.empty()) {
+        Flush();
+        return false;
+    }
+
+    u32 hole = *free_slots.begin();
+    u32 last = slot_names.size() - 1;
+    std::string name = slot_names[last];
+
+    if (fseek(data, SlotOffset(last), SEEK_SET) != 0 || fread(buffer.data(), slot_size, 1, data) != 1 || fseek(data, SlotOffset(hole), SEEK_SET) != 0 ||
+        fwrite(buffer.data(), slot_size, 1, data) != 1) {
+        return false;
+    }
+
+    free_slots.erase(free_slots.begin());
+    slot_names[hole] = name;
+    entries[name].slot = hole;
+
+    slot_names[last].clear();
+    free_slots.insert(last);
+    index_dirty = true;
+    TrimFreeSlots();
+
+    return true;
+}
+
+void ThumbnailStore::Flush() {
+    if (!index_dirty || !data) return;
+
+    // Slots must be on the card before an index pointing at them
+    fflush(data);
+
+    // Write a new index next to the old one and replace it, so a crash leaves one of the two
+    std::string temp_path = index_path + ".tmp";
+    FILE *index = fopen(temp_path.c_str(), "wb");
+    if (!index) return;
+
+    IndexHeader header;
+    memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+    header.version = kVersion;
+    header.count = entries.size();
+    bool written = fwrite(&header, sizeof(header), 1, index) == 1;
+
+    for (const auto &[name, entry] : entries) {
+        IndexEntry index_entry = {};
+        strncpy(index_entry.name, name.c_str(), kMaxNameLength);
+        index_entry.size = entry.key.size;
+        index_entry.mtime = entry.key.mtime;
+        index_entry.slot = entry.slot;
+        written = written && fwrite(&index_entry, sizeof(index_entry), 1, index) == 1;
+    }
+    fclose(index);
+
+    std::error_code error;
+    if (written) {
+        std::filesystem::rename(temp_path, index_path, error);
+        if (error) {
+            // The FS service does not replace existing files on rename
+            std::filesystem::remove(index_path, error);
+            std::filesystem::rename(temp_path, index_path, error);
+        }
+    }
+    if (!written || error) {
+        std::cout << "Failed to write the thumbnail store index " << index_path << '\n';
+        return;
+    }
+
+    index_dirty = false;
+    saves_since_flush = 0;
+}
+}  // namespace screenshots
@@ -42,6 +42,7 @@ size_t selected_index = 0;
 size_t page_index = 0;
 
 size_t last_loaded_thumbs = 0;
+screenshots::ScrollTracker scroll_tracker;
 unsigned int ticks_touch_held = 0;
 unsigned int ticks_a_held = 0;
 
@@ -283,6 +284,8 @@ void Input() {
         changed_selection = false;
         changed_screen = true;
     }
+
+    screenshots::SetScroll(page_index, scroll_tracker.Update(page_index, svcGetSystemTick()));
 }
 
 // Drawing Functions
@@ -308,12 +311,12 @@ void DrawInterface() {
             bool is_selected_multi = multi_selection_mode && multi_selection_screenshots.contains(screenshot->name);
             float offset = is_selected_multi ? kSelectionOutline : 0;
 
-            if (screenshot->has_thumbnail) {
+            if (const C2D_Image *thumbnail = screenshots::GetThumbnail(screenshot)) {
                 float scale_x = is_selected_multi ? (kTopScreenWidth + kSelectionOutline * 8) / static_cast<float>(kTopScreenWidth) : 1;
                 float scale_y = is_selected_multi ? (kTopScreenHeight + kSelectionOutline * 8) / static_cast<float>(kTopScreenHeight) : 1;
 
                 // Draw screenshot thumbnail
-                C2D_DrawImageAt(*screenshot->thumbnail, kHMargin + (kThumbnailWidth + kThumbnailSpacing) * c - offset,
+                C2D_DrawImageAt(*thumbnail, kHMargin + (kThumbnailWidth + kThumbnailSpacing) * c - offset,
                                 kVMargin + (kThumbnailHeight + kThumbnailSpacing) * r - offset, 0, nullptr, scale_x, scale_y);
             } else {
                 // Draw placeholder rect while loading thumbnails